@@ -32,6 +32,25 @@ float targetTPS = 0;
 double maxTPS = 0;
 bool run = true;
 bool breakpoint = false;
+int busWatch = -1;
+bool managedVMem = false;
+// Counters of the ticks run since getPerfCounters() was last called
+SimulationResult perfCounters{};
+
+void addCounters(SimulationResult& total, const SimulationResult& res) {
+	total.numEventsProcessed += res.numEventsProcessed;
+	total.numTicksProcessed += res.numTicksProcessed;
+	total.numHalfTicks += res.numHalfTicks;
+	total.maxHalfTickEvents = max(total.maxHalfTickEvents, res.maxHalfTickEvents);
+	total.numStateChanges += res.numStateChanges;
+	total.numEdgesTraversed += res.numEdgesTraversed;
+	total.numEmitsDeduped += res.numEmitsDeduped;
+	total.skipTime += res.skipTime;
+	total.vmemTime += res.vmemTime;
+	total.queueTime += res.queueTime;
+	total.eventTime += res.eventTime;
+	total.watchTime += res.watchTime;
+}
 
 void simFunc() {
 	double tpsEst = 2 / TARGET_DT;
@@ -53,6 +72,7 @@ void simFunc() {
 			auto s = high_resolution_clock::now();
 			auto res = proj->tick(tickAmount, 100000000ll);
 			auto e = high_resolution_clock::now();
+			addCounters(perfCounters, res);
 			simLock.unlock();
 
 			// Use timings to estimate max possible tps
@@ -65,6 +85,8 @@ void simFunc() {
 				targetTPS = 0;
 				desiredTicks = 0;
 				breakpoint = true;
+				if (res.busWatch >= 0)
+					busWatch = res.busWatch;
 			}
 		}
 
@@ -117,11 +139,18 @@ extern "C" {
 		return res;
 	}
 
+	// Returns the id of the last bus watch that stopped the simulation, or -1
+	EXPORT_API int pollBusWatch() {
+		int res = busWatch;
+		busWatch = -1;
+		return res;
+	}
+
 	EXPORT_API void tick(int tick) {
 		float tps = targetTPS;
 		targetTPS = 0;
 		simLock.lock();
-		proj->tick(tick);
+		addCounters(perfCounters, proj->tick(tick));
 		simLock.unlock();
 		targetTPS = tps;
 	}
@@ -162,10 +191,110 @@ extern "C" {
 		targetTPS = tps;
 	}
 
+	// condition is a BusCondition
+	EXPORT_API int addBusWatch(const char* name, int* gids, int numBits, int condition,
+		unsigned long long value, unsigned long long mask) {
+		simLock.lock();
+		int id = proj->addBusWatch(name, std::vector<int>(gids, gids + numBits),
+			(BusCondition)condition, value, mask);
+		simLock.unlock();
+		return id;
+	}
+
+	EXPORT_API void removeBusWatch(int id) {
+		simLock.lock();
+		proj->removeBusWatch(id);
+		simLock.unlock();
+	}
+
+	EXPORT_API unsigned long long readBusWatch(int id) {
+		simLock.lock();
+		unsigned long long res = 0;
+		if (id >= 0 && id < (int)proj->busWatches.size())
+			res = proj->readBus(proj->busWatches[id].gids);
+		simLock.unlock();
+		return res;
+	}
+
+	EXPORT_API int snapshot() {
+		float tps = targetTPS;
+		targetTPS = 0;
+		simLock.lock();
+		int id = proj->snapshot();
+		simLock.unlock();
+		targetTPS = tps;
+		return id;
+	}
+
+	EXPORT_API void restoreSnapshot(int id) {
+		float tps = targetTPS;
+		targetTPS = 0;
+		simLock.lock();
+		proj->restore(id);
+		simLock.unlock();
+		targetTPS = tps;
+	}
+
+	EXPORT_API void deleteSnapshot(int id) {
+		simLock.lock();
+		proj->deleteSnapshot(id);
+		simLock.unlock();
+	}
+
+	EXPORT_API void recordHistory(unsigned long long maxBytes, int maxTicks) {
+		simLock.lock();
+		proj->recordHistory(maxBytes, maxTicks);
+		simLock.unlock();
+	}
+
+	EXPORT_API void stopHistory() {
+		simLock.lock();
+		proj->stopHistory();
+		simLock.unlock();
+	}
+
+	EXPORT_API int rewind(int numTicks) {
+		float tps = targetTPS;
+		targetTPS = 0;
+		simLock.lock();
+		int res = proj->rewind(numTicks);
+		simLock.unlock();
+		targetTPS = tps;
+		return res;
+	}
+
+	EXPORT_API int replay(int numTicks) {
+		float tps = targetTPS;
+		targetTPS = 0;
+		simLock.lock();
+		int res = proj->replay(numTicks);
+		simLock.unlock();
+		targetTPS = tps;
+		return res;
+	}
+
+	// Fills out with the totals of every tick run since the last call.
+	// maxHalfTickEvents is the largest seen. breakpoint and busWatch are not used.
+	EXPORT_API void getPerfCounters(SimulationResult* out) {
+		simLock.lock();
+		*out = perfCounters;
+		perfCounters = SimulationResult{};
+		simLock.unlock();
+	}
+
 	EXPORT_API void setClockPeriod(unsigned long long period) {
 		proj->clockPeriod = period;
 	}
 
+	EXPORT_API void setNumThreads(int threads) {
+		proj->numThreads = max(0, threads);
+	}
+
+	// Turns the phase times of getPerfCounters() on or off. Off by default.
+	EXPORT_API void setPhaseTiming(bool enabled) {
+		proj->timePhases = enabled;
+	}
+
 	/*
 	* Functions to initialize openVCB
 	*/
@@ -174,6 +303,7 @@ extern "C" {
 		fprintf(stderr, "openVCB: https://github.com/kittybupu/openVCB\n");
 		fprintf(stderr, "openVCB: Jerry#1058\n");
 		proj = new Project;
+		managedVMem = false;
 	}
 
 	EXPORT_API int initProject() {
@@ -201,7 +331,11 @@ extern "C" {
 
 		if (proj) {
 			// These should be managed.
+#ifdef OVCB_SOA
+			proj->stateLogic = nullptr;
+#else
 			proj->states = nullptr;
+#endif
 			proj->vmem = nullptr;
 			proj->image = nullptr;
 
@@ -214,11 +348,19 @@ extern "C" {
 	* Functions to replace openVCB buffers with managed ones
 	*/
 
+#ifdef OVCB_SOA
+	EXPORT_API void setLogicMemory(unsigned char* data, int size) {
+		memcpy(data, proj->stateLogic, size);
+		delete[] proj->stateLogic;
+		proj->stateLogic = data;
+	}
+#else
 	EXPORT_API void setStateMemory(int* data, int size) {
 		memcpy(data, proj->states, sizeof(int) * size);
 		delete[] proj->states;
 		proj->states = (InkState*)data;
 	}
+#endif
 
 	EXPORT_API void addInstrumentBuffer(InkState* buff, int buffSize, int idx) {
 		float tps = targetTPS;
@@ -229,9 +371,124 @@ extern "C" {
 		targetTPS = tps;
 	}
 
+	EXPORT_API int createProbeRing(int capacity) {
+		simLock.lock();
+		int id = proj->createProbeRing(capacity);
+		simLock.unlock();
+		return id;
+	}
+
+	EXPORT_API int addProbe(int gid, int ring, int decimation) {
+		simLock.lock();
+		int id = proj->addProbe(gid, ring, decimation);
+		simLock.unlock();
+		return id;
+	}
+
+	EXPORT_API void removeProbe(int id) {
+		simLock.lock();
+		proj->removeProbe(id);
+		simLock.unlock();
+	}
+
+	// Copies out up to max samples. Safe to call while the simulation runs.
+	// Set dropped to get the number of samples lost to a full ring so far.
+	// Returns -1 if there is no such ring.
+	EXPORT_API int readProbeRing(int ring, ProbeSample* out, int max, unsigned long long* dropped) {
+		ProbeRing* r = proj->getProbeRing(ring);
+		if (!r) return -1;
+		if (dropped)
+			*dropped = r->dropped.load(std::memory_order_relaxed);
+		if (!out || max <= 0) return 0;
+		return (int)r->pop(out, max);
+	}
+
+	// Signal i is made of widths[i] groups taken in order from gids
+	EXPORT_API bool startVCD(const char* path, const char** names, int* gids, int* widths, int numSignals) {
+		std::vector<VCDSignal> signals(numSignals);
+		for (int i = 0; i < numSignals; i++) {
+			signals[i].name = names[i];
+			signals[i].gids.assign(gids, gids + widths[i]);
+			gids += widths[i];
+		}
+
+		simLock.lock();
+		bool res = proj->startVCD(path, signals);
+		simLock.unlock();
+		return res;
+	}
+
+	EXPORT_API void stopVCD() {
+		simLock.lock();
+		proj->stopVCD();
+		simLock.unlock();
+	}
+
+	// Changes the running VCD export lost to a full ring so far
+	EXPORT_API unsigned long long getVCDDropped() {
+		simLock.lock();
+		unsigned long long res = proj->vcdDropped();
+		simLock.unlock();
+		return res;
+	}
+
+	// Timeline of loading and ticks for chrome://tracing or ui.perfetto.dev
+	EXPORT_API void startTrace() {
+		openVCB::startTrace();
+	}
+
+	EXPORT_API bool stopTrace(const char* path) {
+		return openVCB::stopTrace(path);
+	}
+
+#ifdef OVCB_PROFILE
+	EXPORT_API void writeProfile(const char* path, int topN) {
+		simLock.lock();
+		proj->writeProfile(path, topN);
+		simLock.unlock();
+	}
+
+	EXPORT_API void resetProfile() {
+		simLock.lock();
+		proj->resetProfile();
+		simLock.unlock();
+	}
+#endif
+
 	EXPORT_API void setVMemMemory(int* data, int size) {
+		// Managed memory is always flat
+		if (proj->pagedVMem) {
+			delete proj->pagedVMem;
+			proj->pagedVMem = nullptr;
+		}
 		proj->vmem = data;
 		proj->vmemSize = size;
+		proj->vmemDirty = true;
+		managedVMem = true;
+	}
+
+	// Returns the mapped vmem, or null on failure.
+	// Replaces memory given to setVMemMemory(), which the caller still owns.
+	EXPORT_API int* mapVMemFile(const char* path) {
+		simLock.lock();
+		int* managed = nullptr;
+		if (proj->vmemFile == nullptr && proj->vmem && managedVMem) {
+			// Managed memory must not be freed here
+			managed = proj->vmem;
+			int* copy = new int[proj->vmemSize];
+			memcpy(copy, managed, sizeof(int) * proj->vmemSize);
+			proj->vmem = copy;
+		}
+		int* res = proj->mapVMem(path) ? proj->vmem : nullptr;
+		if (res)
+			managedVMem = false;
+		else if (managed) {
+			// Keep simulating on the memory the caller still reads
+			delete[] proj->vmem;
+			proj->vmem = managed;
+		}
+		simLock.unlock();
+		return res;
 	}
 
 	EXPORT_API void setIndicesMemory(int* data, int size) {
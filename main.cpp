@@ -1,51 +1,591 @@
 
 #include "openVCB.h"
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
 #include <memory>
 #include <chrono>
 #include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
 
-int main() {
-	using namespace std::chrono;
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
 
-	auto proj = std::make_unique<openVCB::Project>();
+using namespace std::chrono;
+
+// Resident memory of the process now and at its peak, in bytes
+static void memoryUse(size_t& current, size_t& peak) {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc{};
+	GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+	current = pmc.WorkingSetSize;
+	peak = pmc.PeakWorkingSetSize;
+#else
+	current = 0;
+	if (FILE* file = fopen("/proc/self/statm", "r")) {
+		size_t pages = 0, resident = 0;
+		if (fscanf(file, "%zu %zu", &pages, &resident) == 2)
+			current = resident * sysconf(_SC_PAGESIZE);
+		fclose(file);
+	}
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	peak = (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+// Bits of one copy of each generated circuit
+static const int benchBits[] = { 16, 16, 64, 8, 16, 256, 256 };
+
+// Runs each generated circuit at 1K, 10K, ... up to maxPixels pixels.
+// Ticks in growing batches until minSeconds have been simulated.
+static void bench(long long maxPixels, double minSeconds) {
+	using namespace openVCB;
+	printf("%-8s %11s %10s %10s %11s %11s %11s %13s %9s %9s\n", "circuit", "pixels", "groups", "edges",
+		"preprocess", "ticks", "TPS", "events/s", "RSS MB", "peak MB");
+
+	for (int c = 0; c < (int)SynthCircuit::numTypes; c++) {
+		long long lastPixels = -1;
+		for (long long size = 1000; size <= maxPixels; size *= 10) {
+			auto proj = std::make_unique<Project>();
+			proj->generateCircuit((SynthCircuit)c, benchBits[c], size);
+			// Small sizes can round up to the same single copy
+			const long long pixels = (long long)proj->width * proj->height;
+			if (pixels == lastPixels) continue;
+			lastPixels = pixels;
+
+			auto start = steady_clock::now();
+			proj->preprocess(false);
+			const double preprocessTime = duration_cast<duration<double>>(steady_clock::now() - start).count();
+
+			long long ticks = 0, events = 0;
+			double simTime = 0;
+			for (int batch = 1; simTime < minSeconds; batch = std::min(batch * 2, 1 << 20)) {
+				start = steady_clock::now();
+				SimulationResult res = proj->tick(batch);
+				simTime += duration_cast<duration<double>>(steady_clock::now() - start).count();
+				ticks += res.numTicksProcessed;
+				events += res.numEventsProcessed;
+			}
 
-	std::vector<std::pair<const char*, steady_clock::time_point>> times;
-	times.reserve(100);
+			size_t rss, peak;
+			memoryUse(rss, peak);
+			printf("%-8s %11lld %10d %10d %10.3fs %11lld %11.1f %13.4g %9.1f %9.1f\n",
+				synthCircuitNames[c], pixels, proj->numGroups, proj->writeMap.nnz, preprocessTime,
+				ticks, ticks / simTime, events / simTime, rss / 1048576., peak / 1048576.);
+		}
+	}
+}
+
+static void usage() {
+	fprintf(stderr,
+		"usage: openVCB [file] [options]\n"
+		"       openVCB bench [maxPixels] [seconds]\n"
+		"       openVCB golden record <golden> [boards] [--ticks N] [--every N]\n"
+		"       openVCB golden check <golden> [--engine LIST] [--threads N] [--gorder]\n"
+		"\n"
+		"Loads, preprocesses, assembles and ticks a board, then prints the timings as JSON.\n"
+		"file is a .vcb file or synth:<circuit>[:bits[:pixels]] for a generated circuit\n"
+		"(ripple, cla, shift, ram, divider, fanout, xortree). Default sampleProject.vcb\n"
+		"\n"
+		"  --ticks N      ticks to run each time (1000000)\n"
+		"  --gorder       reorder groups with Gorder\n"
+		"  --threads N    threads for the multithreaded engine, 0 for all cores (0)\n"
+		"  --engine LIST  comma separated: serial or mt, packed, elide, cycles (mt when built\n"
+		"                 with OVCB_MT, serial otherwise)\n"
+		"  --warmup N     runs to do before timing (1)\n"
+		"  --reps N       timed runs (5)\n"
+		"  --dump PATH    write the final vmem of the last run to a text file\n"
+		"  --trace PATH   write a Chrome trace of the last run\n"
+		"\n"
+		"golden record runs boards on the reference engine (serial, no engine options, no Gorder)\n"
+		"and saves a rolling hash of group states and vmem every N ticks (100000 ticks, every 1000).\n"
+		"Without boards it uses sampleProject.vcb and every generated circuit.\n"
+		"golden check runs the same boards with the given options and reports the first tick\n"
+		"and group that differ from the reference engine.\n");
+}
+
+// Options of one run. Every repetition starts from a fresh project.
+struct RunOptions {
+	std::string file = "sampleProject.vcb";
+	int ticks = 1000000;
+	bool gorder = false;
+	int threads = 0;
+	std::string engine;
+	bool multithreaded = false;
+	bool packed = false;
+	bool elide = false;
+	bool cycles = false;
+	int warmup = 1;
+	int reps = 5;
+	std::string dumpPath;
+	std::string tracePath;
+	// Ticks between golden hashes, and the boards to record
+	int every = 1000;
+	std::vector<std::string> boards;
+};
+
+// Sets the engine flags from a list like "mt,packed". Returns false on an unknown name.
+static bool parseEngine(RunOptions& opt, const std::string& list) {
+#ifdef OVCB_MT
+	opt.multithreaded = true;
+#endif
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t end = list.find(',', pos);
+		if (end == std::string::npos) end = list.size();
+		const std::string name = list.substr(pos, end - pos);
+		pos = end + 1;
 
-	// Read .vcb file
-	times.push_back({ "File read", high_resolution_clock::now() });
-	proj->readFromVCB("sampleProject.vcb");
+		if (name == "serial") opt.multithreaded = false;
+		else if (name == "mt") {
+#ifndef OVCB_MT
+			fprintf(stderr, "error: The mt engine needs a build with OVCB_MT\n");
+			return false;
+#endif
+			opt.multithreaded = true;
+		}
+		else if (name == "packed") opt.packed = true;
+		else if (name == "elide") opt.elide = true;
+		else if (name == "cycles") opt.cycles = true;
+		else if (name.size()) {
+			fprintf(stderr, "error: Unknown engine option %s\n", name.c_str());
+			return false;
+		}
+	}
 
-	times.push_back({ "Project preprocess", high_resolution_clock::now() });
-	const bool useGorder = false;
-	proj->preprocess(useGorder);
+	opt.engine = opt.multithreaded ? "mt" : "serial";
+	if (opt.packed) opt.engine += ",packed";
+	if (opt.elide) opt.engine += ",elide";
+	if (opt.cycles) opt.engine += ",cycles";
+	return true;
+}
 
-	times.push_back({ "VMem assembly", high_resolution_clock::now() });
+static bool parseArgs(RunOptions& opt, int argc, char** argv) {
+	std::string engine;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		// Options that take a value
+		const bool hasValue = i + 1 < argc;
+		if (arg == "--help" || arg == "-h") return false;
+		else if (arg == "--gorder") opt.gorder = true;
+		else if (arg == "--ticks" && hasValue) opt.ticks = atoi(argv[++i]);
+		else if (arg == "--threads" && hasValue) opt.threads = atoi(argv[++i]);
+		else if (arg == "--engine" && hasValue) engine = argv[++i];
+		else if (arg == "--warmup" && hasValue) opt.warmup = atoi(argv[++i]);
+		else if (arg == "--reps" && hasValue) opt.reps = atoi(argv[++i]);
+		else if (arg == "--every" && hasValue) opt.every = atoi(argv[++i]);
+		else if (arg == "--dump" && hasValue) opt.dumpPath = argv[++i];
+		else if (arg == "--trace" && hasValue) opt.tracePath = argv[++i];
+		else if (arg[0] != '-') {
+			opt.file = arg;
+			opt.boards.push_back(arg);
+		}
+		else {
+			fprintf(stderr, "error: Unknown or incomplete option %s\n", arg.c_str());
+			return false;
+		}
+	}
+	if (opt.ticks < 0 || opt.warmup < 0 || opt.reps < 1 || opt.threads < 0 || opt.every < 1) {
+		fprintf(stderr, "error: Counts must be positive\n");
+		return false;
+	}
+#ifndef OVCB_MT
+	if (opt.threads > 1) {
+		fprintf(stderr, "error: --threads needs a build with OVCB_MT\n");
+		return false;
+	}
+#endif
+	return parseEngine(opt, engine);
+}
+
+// Builds the project from a file or a synth:<circuit>[:bits[:pixels]] name
+static bool load(openVCB::Project& proj, const std::string& file) {
+	using namespace openVCB;
+	if (file.compare(0, 6, "synth:") != 0) {
+		proj.readFromVCB(file);
+		return true;
+	}
+
+	std::string name = file.substr(6);
+	int bits = 32;
+	long long pixels = 0;
+	const size_t colon = name.find(':');
+	if (colon != std::string::npos) {
+		sscanf(name.c_str() + colon + 1, "%d:%lld", &bits, &pixels);
+		name.resize(colon);
+	}
+	for (int c = 0; c < (int)SynthCircuit::numTypes; c++)
+		if (name == synthCircuitNames[c]) {
+			proj.generateCircuit((SynthCircuit)c, bits, pixels);
+			return true;
+		}
+	fprintf(stderr, "error: Unknown circuit %s\n", name.c_str());
+	return false;
+}
+
+static void setEngine(openVCB::Project& proj, const RunOptions& opt) {
+	proj.usePackedEdges = opt.packed;
+	proj.elideTraces = opt.elide;
+	proj.detectCycles = opt.cycles;
+	proj.numThreads = opt.multithreaded ? opt.threads : 1;
+}
+
+// Loads, preprocesses and assembles a board. Returns null if it could not be loaded.
+static std::unique_ptr<openVCB::Project> prepare(const RunOptions& opt, const std::string& board) {
+	auto proj = std::make_unique<openVCB::Project>();
+	setEngine(*proj, opt);
+	if (!load(*proj, board))
+		return nullptr;
+	proj->preprocess(opt.gorder);
 	proj->assembleVmem();
+	return proj;
+}
+
+// Timings of one stage over all timed runs
+struct StageTimes {
+	const char* name = "";
+	std::vector<double> seconds = {};
+};
+
+static double median(std::vector<double> v) {
+	std::sort(v.begin(), v.end());
+	return v.size() & 1 ? v[v.size() / 2] : 0.5 * (v[v.size() / 2 - 1] + v[v.size() / 2]);
+}
+
+static void printStats(const StageTimes& stage, bool last) {
+	std::vector<double> v = stage.seconds;
+	std::sort(v.begin(), v.end());
+	// Nearest rank
+	const double p95 = v[(size_t)std::ceil(0.95 * v.size()) - 1];
+	printf("    \"%s\": { \"median\": %.6f, \"p95\": %.6f, \"min\": %.6f }%s\n",
+		stage.name, median(v), p95, v[0], last ? "" : ",");
+}
+
+// Escapes a path for a JSON string
+static std::string jsonString(const std::string& str) {
+	std::string out;
+	for (char c : str) {
+		if (c == '"' || c == '\\') out += '\\';
+		out += c;
+	}
+	return out;
+}
+
+// Boards checked when none are given. Sizes are kept small so a check runs in seconds.
+static const char* goldenCorpus[] = {
+	"sampleProject.vcb",
+	"synth:ripple:16:100000",
+	"synth:cla:16:100000",
+	"synth:shift:64:100000",
+	"synth:ram:8:100000",
+	"synth:divider:16:100000",
+	"synth:fanout:256:100000",
+	"synth:xortree:256:100000",
+};
+
+// Hashes of one board every few ticks
+struct GoldenBoard {
+	std::string name;
+	int ticks;
+	int every;
+	// Tick and rolling hash
+	std::vector<std::pair<int, uint64_t>> hashes;
+};
+
+// Everything else is compared against this engine
+static RunOptions referenceEngine(const RunOptions& opt) {
+	RunOptions ref = opt;
+	ref.gorder = false;
+	ref.multithreaded = ref.packed = ref.elide = ref.cycles = false;
+	ref.engine = "serial";
+	return ref;
+}
+
+// Ticks to the next hash and folds the state into the rolling hash
+static uint64_t goldenStep(openVCB::Project& proj, int ticks, uint64_t rolling) {
+	proj.tick(ticks);
+	return openVCB::hashKey(rolling ^ proj.stateDigest());
+}
+
+static int goldenRecord(const std::string& path, RunOptions opt) {
+	if (opt.boards.empty())
+		opt.boards.assign(std::begin(goldenCorpus), std::end(goldenCorpus));
+	const RunOptions ref = referenceEngine(opt);
+
+	FILE* file;
+	fopen_s(&file, path.c_str(), "w");
+	if (!file) {
+		fprintf(stderr, "error: Could not open golden file %s\n", path.c_str());
+		return 1;
+	}
+	for (auto& board : opt.boards) {
+		auto proj = prepare(ref, board);
+		if (!proj) {
+			fclose(file);
+			return 1;
+		}
+		fprintf(stderr, "Recording %s\n", board.c_str());
+		fprintf(file, "board %d %d %s\n", opt.ticks, opt.every, board.c_str());
+		uint64_t rolling = 0;
+		for (int t = 0; t < opt.ticks; t += opt.every) {
+			const int n = std::min(opt.every, opt.ticks - t);
+			rolling = goldenStep(*proj, n, rolling);
+			fprintf(file, "%d %016llx\n", t + n, (unsigned long long)rolling);
+		}
+	}
+	fclose(file);
+	return 0;
+}
+
+static bool readGolden(const std::string& path, std::vector<GoldenBoard>& boards) {
+	FILE* file;
+	fopen_s(&file, path.c_str(), "r");
+	if (!file) {
+		fprintf(stderr, "error: Could not open golden file %s\n", path.c_str());
+		return false;
+	}
+	char line[4096];
+	while (fgets(line, sizeof(line), file)) {
+		int ticks, every, nameStart;
+		int tick;
+		unsigned long long hash;
+		if (sscanf(line, "board %d %d %n", &ticks, &every, &nameStart) == 2) {
+			std::string name = line + nameStart;
+			while (name.size() && (name.back() == '\n' || name.back() == '\r'))
+				name.pop_back();
+			boards.push_back({ name, ticks, every, {} });
+		}
+		else if (boards.size() && sscanf(line, "%d %llx", &tick, &hash) == 2)
+			boards.back().hashes.push_back({ tick, hash });
+	}
+	fclose(file);
+	return true;
+}
+
+// Steps the board one tick at a time on both engines from the last hash that matched,
+// and prints the first group or vmem word that differs
+static void findDivergence(const RunOptions& opt, const GoldenBoard& board, int bad) {
+	using namespace openVCB;
+	const RunOptions refOpt = referenceEngine(opt);
+	auto ref = prepare(refOpt, board.name);
+	auto test = prepare(opt, board.name);
+
+	// Run both the way the check did up to the last hash that matched
+	const int start = bad > 0 ? board.hashes[bad - 1].first : 0;
+	uint64_t rolling = 0;
+	for (int t = 0; t < start; t += board.every) {
+		const int n = std::min(board.every, start - t);
+		rolling = goldenStep(*ref, n, rolling);
+		test->tick(n);
+	}
+
+	// Groups are matched by their first pixel, as Gorder numbers them differently
+	const std::vector<int>& pixels = ref->firstPixels();
+	std::vector<int> testGid(ref->numGroups);
+	for (int gid = 0; gid < ref->numGroups; gid++)
+		testGid[gid] = test->indexImage[pixels[gid]];
+
+	const int end = board.hashes[bad].first;
+	for (int t = start; t < end; t++) {
+		ref->tick(1);
+		test->tick(1);
+
+		// Traces come first, so also list a few others to show which component went wrong
+		std::vector<int> diff;
+		for (int gid = 0; gid < ref->numGroups; gid++)
+			if (getOn((Logic)ref->logicOf(gid)) != getOn((Logic)test->logicOf(testGid[gid])))
+				diff.push_back(gid);
+		if (diff.size()) {
+			printf("  first divergence after tick %d in %zu groups:\n", t + 1, diff.size());
+			for (size_t i = 0; i < diff.size() && i < 8; i++) {
+				const int gid = diff[i];
+				const bool refOn = getOn((Logic)ref->logicOf(gid));
+				printf("    group %d (%s at %d, %d) is %s but the reference has it %s\n",
+					gid, getInkString(ref->stateInks[gid]), pixels[gid] % ref->width, pixels[gid] / ref->width,
+					refOn ? "off" : "on", refOn ? "on" : "off");
+			}
+			return;
+		}
+		if (ref->vmemHash != test->vmemHash) {
+			size_t first = ref->vmemSize;
+			auto compare = [&](size_t addr) {
+				if (addr < first && ref->readVMem((uint32_t)addr) != test->readVMem((uint32_t)addr))
+					first = addr;
+			};
+			if (ref->pagedVMem) {
+				// Pages not allocated on either side are zero on both
+				auto comparePage = [&](uint32_t base, const int*) {
+					for (size_t i = 0; i < PagedVMem::pageSize; i++)
+						compare(base + i);
+				};
+				ref->pagedVMem->forEachPage(comparePage);
+				test->pagedVMem->forEachPage(comparePage);
+			}
+			else
+				for (size_t addr = 0; addr < ref->vmemSize && first == ref->vmemSize; addr++)
+					compare(addr);
+
+			if (first < ref->vmemSize) {
+				printf("  first divergence after tick %d: vmem[0x%08zx] is 0x%08x but the reference has 0x%08x\n",
+					t + 1, first, test->readVMem((uint32_t)first), ref->readVMem((uint32_t)first));
+				return;
+			}
+		}
+	}
+
+	// The reference engine of this build may itself disagree with the file
+	if (openVCB::hashKey(rolling ^ ref->stateDigest()) != board.hashes[bad].second)
+		printf("  the reference engine of this build also differs from the golden file by tick %d\n", end);
+	else
+		printf("  no difference when stepping one tick at a time between ticks %d and %d\n", start, end);
+}
+
+static int goldenCheck(const std::string& path, const RunOptions& opt) {
+	std::vector<GoldenBoard> boards;
+	if (!readGolden(path, boards))
+		return 1;
+
+	int failures = 0;
+	for (auto& board : boards) {
+		auto proj = prepare(opt, board.name);
+		if (!proj)
+			return 1;
+
+		int bad = -1;
+		uint64_t rolling = 0;
+		for (size_t i = 0, t = 0; i < board.hashes.size(); i++) {
+			rolling = goldenStep(*proj, board.hashes[i].first - (int)t, rolling);
+			t = board.hashes[i].first;
+			if (rolling != board.hashes[i].second) {
+				bad = (int)i;
+				break;
+			}
+		}
+
+		if (bad < 0) {
+			printf("ok   %s\n", board.name.c_str());
+			continue;
+		}
+		printf("FAIL %s: hash differs at tick %d\n", board.name.c_str(), board.hashes[bad].first);
+		fflush(stdout);
+		findDivergence(opt, board, bad);
+		failures++;
+	}
+	printf("%d of %zu boards match (%s%s)\n", (int)boards.size() - failures, boards.size(),
+		opt.engine.c_str(), opt.gorder ? ",gorder" : "");
+	return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+	// openVCB bench [maxPixels] [seconds]
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		bench(argc > 2 ? atoll(argv[2]) : 100000000, argc > 3 ? atof(argv[3]) : 1.0);
+		return 0;
+	}
+
+	// openVCB golden record|check <golden> [options]
+	if (argc > 1 && strcmp(argv[1], "golden") == 0) {
+		RunOptions opt;
+		opt.ticks = 100000;
+		const bool record = argc > 2 && strcmp(argv[2], "record") == 0;
+		const bool check = argc > 2 && strcmp(argv[2], "check") == 0;
+		if ((!record && !check) || argc < 4 || !parseArgs(opt, argc - 3, argv + 3)) {
+			usage();
+			return 1;
+		}
+		return record ? goldenRecord(argv[3], opt) : goldenCheck(argv[3], opt);
+	}
+
+	RunOptions opt;
+	if (!parseArgs(opt, argc, argv)) {
+		usage();
+		return 1;
+	}
+
+	StageTimes stages[] = { { "read" }, { "preprocess" }, { "assemble" }, { "tick" } };
+	openVCB::SimulationResult res{};
+	int numGroups = 0, numEdges = 0;
+
+	for (int run = 0; run < opt.warmup + opt.reps; run++) {
+		const bool timed = run >= opt.warmup;
+		const bool lastRun = run == opt.warmup + opt.reps - 1;
+		fprintf(stderr, "%s run %d of %d\n", timed ? "Timed" : "Warmup",
+			timed ? run - opt.warmup + 1 : run + 1, timed ? opt.reps : opt.warmup);
+		if (lastRun && opt.tracePath.size())
+			openVCB::startTrace();
 
-	printf("Loaded %d groups and %d connections.\n", proj->numGroups, proj->writeMap.nnz);
-	printf("Simulating 1 million ticks into the future...\n");
+		auto proj = std::make_unique<openVCB::Project>();
+		setEngine(*proj, opt);
 
-	// Advance 1 million ticks
-	times.push_back({ "Advance 1 million ticks", high_resolution_clock::now() });
-	proj->tick(1000000);
+		double t[4];
+		auto start = steady_clock::now();
+		auto lap = [&](double& time) {
+			auto now = steady_clock::now();
+			time = duration_cast<duration<double>>(now - start).count();
+			start = now;
+		};
 
-	times.push_back({ "End", high_resolution_clock::now() });
+		if (!load(*proj, opt.file))
+			return 1;
+		lap(t[0]);
+		proj->preprocess(opt.gorder);
+		lap(t[1]);
+		proj->assembleVmem();
+		lap(t[2]);
+		res = proj->tick(opt.ticks);
+		lap(t[3]);
 
-	printf("\nDone.\n\n");
+		if (lastRun && opt.tracePath.size() && !openVCB::stopTrace(opt.tracePath))
+			return 1;
+		if (lastRun && opt.dumpPath.size()) {
+			if (proj->hasVMem())
+				proj->dumpVMemToText(opt.dumpPath);
+			else
+				fprintf(stderr, "Board has no vmem to dump\n");
+		}
 
-	for (size_t i = 0; i < times.size() - 1; i++) {
-		auto start = times[i].second;
-		auto end = times[i + 1].second;
-		double elapsed = duration_cast<duration<double>>(end - start).count();
-		printf("%s took %.3f seconds.\n", times[i].first, elapsed);
+		numGroups = proj->numGroups;
+		numEdges = proj->writeMap.nnz;
+		if (!timed) continue;
+		for (int i = 0; i < 4; i++)
+			stages[i].seconds.push_back(t[i]);
 	}
 
-	double simTime = duration_cast<duration<double>>
-		(times[times.size() - 1].second - times[times.size() - 2].second).count();
-	printf("Average TPS: %.1f\n\n", 1000000. / simTime);
+	size_t rss, peak;
+	memoryUse(rss, peak);
 
-	proj->dumpVMemToText("vmemDump.txt");
-	printf("Final VMem contents dumped to vmemDump.txt!\n");
-}
\ No newline at end of file
+	printf("{\n");
+	printf("  \"file\": \"%s\",\n", jsonString(opt.file).c_str());
+	printf("  \"ticks\": %d,\n", opt.ticks);
+	printf("  \"gorder\": %s,\n", opt.gorder ? "true" : "false");
+	printf("  \"threads\": %d,\n", opt.threads);
+	printf("  \"engine\": \"%s\",\n", opt.engine.c_str());
+	printf("  \"warmup\": %d,\n", opt.warmup);
+	printf("  \"reps\": %d,\n", opt.reps);
+	printf("  \"groups\": %d,\n", numGroups);
+	printf("  \"edges\": %d,\n", numEdges);
+	// Counters of the last run
+	printf("  \"events\": %lld,\n", res.numEventsProcessed);
+	printf("  \"stateChanges\": %lld,\n", res.numStateChanges);
+	printf("  \"edgesTraversed\": %lld,\n", res.numEdgesTraversed);
+	printf("  \"peakRSS\": %zu,\n", peak);
+	// Rates at the median tick time
+	const double tickTime = median(stages[3].seconds);
+	printf("  \"ticksPerSecond\": %.1f,\n", res.numTicksProcessed / tickTime);
+	printf("  \"eventsPerSecond\": %.1f,\n", res.numEventsProcessed / tickTime);
+	printf("  \"seconds\": {\n");
+	for (int i = 0; i < 4; i++)
+		printStats(stages[i], i == 3);
+	printf("  }\n");
+	printf("}\n");
+	return 0;
+}
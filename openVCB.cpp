@@ -17,15 +17,40 @@ namespace openVCB {
 	void Project::toggleLatch(int gid) {
 		if (setOff(stateInks[gid]) != Ink::LatchOff)
 			return;
-		states[gid].activeInputs = 1;
-		if (states[gid].visited) return;
-		states[gid].visited = 1;
-		updateQ[0][qSize++] = gid;
+		inputsOf(gid) = 1;
+		pushEvent(gid);
+		if (history) {
+			truncateHistory();
+			history->cur.toggles.push_back(gid);
+		}
+	}
+
+	const std::vector<int>& Project::firstPixels() {
+		if (groupFirstPixel.empty()) {
+			groupFirstPixel.assign(numGroups, -1);
+			for (int i = 0, lim = width * height; i < lim; i++) {
+				const int gid = indexImage[i];
+				if (gid >= 0 && groupFirstPixel[gid] < 0)
+					groupFirstPixel[gid] = i;
+			}
+		}
+		return groupFirstPixel;
+	}
+
+	uint64_t Project::stateDigest() {
+		const std::vector<int>& pixels = firstPixels();
+		uint64_t hash = 0;
+		for (int gid = 0; gid < numGroups; gid++)
+			if (getOn((Logic)logicOf(gid)))
+				hash ^= hashKey((uint64_t)pixels[gid]);
+		return hash ^ (vmemHash * 3);
 	}
 
 	Project::~Project() {
 		if (originalImage) delete[] originalImage;
-		if (vmem) delete[] vmem;
+		if (vmemFile) closeVMemFile();
+		else if (vmem) delete[] vmem;
+		if (pagedVMem) delete pagedVMem;
 		if (image) delete[] image;
 		if (indexImage) delete[] indexImage;
 		if (decoration[0]) delete[] decoration[0];
@@ -33,10 +58,25 @@ namespace openVCB {
 		if (decoration[2]) delete[] decoration[2];
 		if (writeMap.ptr) delete[] writeMap.ptr;
 		if (writeMap.rows) delete[] writeMap.rows;
+		if (packedMap.index) delete[] packedMap.index;
+		if (packedMap.data) delete[] packedMap.data;
+#ifdef OVCB_SOA
+		if (stateLogic) delete[] stateLogic;
+		if (stateInputs) delete[] stateInputs;
+#else
 		if (states) delete[] states;
+#endif
+		if (visitEpoch) delete[] visitEpoch;
 		if (stateInks) delete[] stateInks;
 		if (updateQ[0]) delete[] updateQ[0];
 		if (updateQ[1]) delete[] updateQ[1];
+		if (deferQ) delete[] deferQ;
+		for (auto snap : snapshots)
+			if (snap) delete snap;
+		if (history) delete history;
+		if (vcd) stopVCD();
+		for (auto ring : probeRings)
+			delete ring;
 		if (lastActiveInputs) delete[] lastActiveInputs;
 	}
 
@@ -52,7 +92,7 @@ namespace openVCB {
 
 		if (idx == -1) return { Ink::None, -1 };
 
-		unsigned char state = states[idx].logic;
+		unsigned char state = logicOf(idx);
 		type = (Ink)(((int)type & 0x7f) | (state & 0x80));
 		return { type, idx };
 	}
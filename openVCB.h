@@ -8,14 +8,23 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+
+#include "openVCBTrace.h"
 
 // Enable multithreading
 // #define OVCB_MT
 
-#ifdef OVCB_MT
-#include <atomic>
-#endif
+// Store group states as seperate arrays instead of InkState structs
+// #define OVCB_SOA
+
+// Count the events, state changes and edge visits of every group.
+// See Project::writeProfile()
+// #define OVCB_PROFILE
 
 /// <summary>
 /// Primary namespace for openVCB
@@ -189,24 +198,60 @@ namespace openVCB {
 	// Gets the string name of the ink
 	const char* getInkString(Ink ink);
 
+	// The multithreaded engine updates these through atomicRef()
+	// so the layout stays the same with and without OVCB_MT.
 	struct InkState {
-#ifdef OVCB_MT
-		// Number of active inputs
-		std::atomic<int16_t> activeInputs;
-
-		// Flags for traversal
-		std::atomic<unsigned char> visited;
-#else
 		// Number of active inputs
 		int16_t activeInputs;
-		// Flags for traversal
+		// Flags for traversal. 
+		// The engine tracks this in Project::visitEpoch. Kept for the C# layout.
 		unsigned char visited;
-#endif
 
 		// Current logic state
 		unsigned char logic;
 	};
 
+#ifdef OVCB_MT
+	// Views a plain value as an atomic for lock free updates
+	template<typename T>
+	inline std::atomic<T>& atomicRef(T& val) {
+		static_assert(sizeof(std::atomic<T>) == sizeof(T), "atomic and plain layouts differ");
+		return reinterpret_cast<std::atomic<T>&>(val);
+	}
+#endif
+
+	// Mixes the bits of a key for the state hashes
+	inline uint64_t hashKey(uint64_t x) {
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ull;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebull;
+		x ^= x >> 31;
+		return x;
+	}
+
+	// Connections in writeMap carry the logic type of the group they write to
+	// in their top bits. This lets the engine filter them without reading
+	// the target state. Limits boards to 2^28 groups.
+	const int edgeTypeShift = 28;
+	const int edgeTypeMask = 7;
+	const int edgeGIDMask = (1 << edgeTypeShift) - 1;
+	// Set on connections that skip an elided trace. 
+	// Their events wait one extra half tick, as the trace would have.
+	const int edgeDelayBit = (int)0x80000000u;
+
+	// Bits of Project::groupFlags. The engine checks these whenever a group flips.
+	enum GroupFlag : unsigned char {
+		// Address and data latches of vmem
+		FlagVMemPort = 1,
+		// Groups with a breakpoint, or the writers of elided traces with one
+		FlagWatch = 2,
+		// Bits of a bus watch, or the writers of elided traces in one
+		FlagBus = 4,
+		// Groups followed by a probe, or the writers of elided traces with one
+		FlagProbe = 8,
+	};
+
 	struct SparseMat {
 		// Size of the matrix
 		int n;
@@ -214,10 +259,49 @@ namespace openVCB {
 		int nnz;
 		// CSC sparse matrix ptr
 		int* ptr;
-		// CSC sparse matrix rows
+		// CSC sparse matrix rows.
+		// For writeMap, these are tagged with the target logic type. See edgeTypeShift
 		int* rows;
 	};
 
+	// Delta encoded sparse matrix for large boards.
+	// Each column stores its first row and then 16 bit gaps to the next row.
+	// Gaps that do not fit are stored as 0xffff followed by the full row in two halves.
+	struct PackedMat {
+		// Size of the matrix
+		int n;
+		// Number of non-zero entries
+		int nnz;
+		// Start in data and first row of each column, interleaved.
+		// The first row is -1 for empty columns.
+		int* index;
+		// Encoded gaps
+		uint16_t* data;
+		// Number of entries in data
+		size_t dataSize;
+
+		// Calls f on every row of a column
+		template<typename F>
+		inline void forEachRow(int col, F f) const {
+			int row = index[2 * col + 1];
+			if (row == -1) return;
+			f(row);
+
+			const uint16_t* ptr = data + index[2 * col];
+			const uint16_t* end = data + index[2 * col + 2];
+			while (ptr < end) {
+				const uint16_t gap = *ptr++;
+				if (gap == 0xffff) {
+					row = (int)((uint32_t)ptr[0] | ((uint32_t)ptr[1] << 16));
+					ptr += 2;
+				}
+				else
+					row += gap;
+				f(row);
+			}
+		}
+	};
+
 	// This represents a pixel with meta data as well as simulation ink type
 	// Ths is for inks that have variants which do not affect simulation
 	// i.e. Colored traces. 
@@ -238,20 +322,333 @@ namespace openVCB {
 		int idx;
 	};
 
+	// One value change seen by a probe
+	struct ProbeSample {
+		// Tick after which the group holds value
+		unsigned long long tick;
+		int gid;
+		int value;
+	};
+
+	// Lock free ring of probe samples. tick() is the only writer
+	// and one other thread may read at the same time.
+	struct ProbeRing {
+		std::vector<ProbeSample> data;
+		size_t mask;
+		// Samples written and read. Kept on their own cache lines.
+		alignas(64) std::atomic<unsigned long long> head{ 0 };
+		alignas(64) std::atomic<unsigned long long> tail{ 0 };
+		// Changes that found the ring full. Their probes send the newest value
+		// once there is room, so the changes in between are lost.
+		std::atomic<unsigned long long> dropped{ 0 };
+
+		// Capacity is rounded up to a power of two
+		ProbeRing(size_t capacity) {
+			size_t size = 1;
+			while (size < capacity)
+				size <<= 1;
+			data.resize(size);
+			mask = size - 1;
+		}
+
+		// Writer side. Returns false if the reader fell behind and the ring is full.
+		inline bool push(const ProbeSample& s) {
+			const unsigned long long h = head.load(std::memory_order_relaxed);
+			if (h - tail.load(std::memory_order_acquire) > mask)
+				return false;
+			data[h & mask] = s;
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Reader side. Copies out up to max samples and returns the number copied
+		inline size_t pop(ProbeSample* out, size_t max) {
+			const unsigned long long t = tail.load(std::memory_order_relaxed);
+			const size_t n = (size_t)std::min<unsigned long long>(head.load(std::memory_order_acquire) - t, max);
+			for (size_t i = 0; i < n; i++)
+				out[i] = data[(t + i) & mask];
+			tail.store(t + n, std::memory_order_release);
+			return n;
+		}
+	};
+
+	// Streams the value changes of one group into a ProbeRing. See Project::addProbe()
+	struct Probe {
+		// -1 once removed
+		int gid;
+		int ring;
+		// Least number of ticks between samples
+		int decimation;
+		// Value and tick of the last sample
+		bool last;
+		unsigned long long lastTick;
+		// Set while a change waits for the decimation interval to pass
+		bool pending;
+		// Set while a change waits for room in the ring. last still holds the value sent.
+		bool full;
+	};
+
+	// Sparse vmem for wide address buses. Pages are allocated on their first write.
+	// Until then they read from one shared page of zeros.
+	struct PagedVMem {
+		// 4 KiB pages, 2048 pages per table
+		static constexpr int pageBits = 10;
+		static constexpr int tableBits = 11;
+		static constexpr int pageSize = 1 << pageBits;
+		static constexpr uint32_t pageMask = pageSize - 1;
+		static constexpr uint32_t tableMask = (1u << tableBits) - 1;
+
+		// Shared by every page and table that has not been written
+		static int zeroPage[pageSize];
+		static int* zeroTable[1 << tableBits];
+
+		// Top level of the page table
+		int*** tables = nullptr;
+		size_t numTables = 0;
+		// Number of pages allocated
+		size_t numPages = 0;
+
+		PagedVMem(int addrBits);
+		~PagedVMem();
+
+		inline int read(uint32_t addr) const {
+			return tables[addr >> (pageBits + tableBits)][(addr >> pageBits) & tableMask][addr & pageMask];
+		}
+
+		inline void write(uint32_t addr, int data) {
+			pageOf(addr)[addr & pageMask] = data;
+		}
+
+		// Gets the page holding addr. Allocates it if it was never written.
+		int* pageOf(uint32_t addr);
+
+		// Gets the page holding addr, or null if it was never written
+		inline const int* findPage(uint32_t addr) const {
+			const int* page = tables[addr >> (pageBits + tableBits)][(addr >> pageBits) & tableMask];
+			return page == zeroPage ? nullptr : page;
+		}
+
+		// Calls f(first address, page) for every allocated page in address order
+		template<typename F>
+		void forEachPage(F f) const {
+			for (size_t t = 0; t < numTables; t++)
+				if (tables[t] != zeroTable)
+					for (uint32_t p = 0; p <= tableMask; p++)
+						if (tables[t][p] != zeroPage)
+							f((uint32_t)((t << tableBits | p) << pageBits), tables[t][p]);
+		}
+
+		// Copies out every allocated page
+		void save(std::vector<uint32_t>& addrs, std::vector<int>& data) const;
+		// Checks the contents against pages from save()
+		bool equals(const std::vector<uint32_t>& addrs, const std::vector<int>& data) const;
+	};
+
+	// A file mapped into memory as vmem. Defined in openVCBVMem.cpp
+	struct VMemFile;
+
+	// Activity of one group counted with OVCB_PROFILE
+	struct GroupProfile {
+		// Times the group was updated
+		uint64_t events;
+		// Updates that changed its state. The rest were wasted.
+		uint64_t changes;
+		// Connections followed to notify its readers
+		uint64_t edges;
+	};
+
+	// A wire or bus in a VCD file. See Project::startVCD()
+	struct VCDSignal {
+		std::string name;
+		// Group of each bit, least significant first. One group makes a wire.
+		std::vector<int> gids;
+	};
+
+	// A VCD file written by a background thread. Defined in openVCBVCD.cpp
+	struct VCDExport;
+
+	// Circuits drawn by Project::generateCircuit() for benchmarks
+	enum class SynthCircuit {
+		// Full adders with a rippling carry
+		RippleAdder,
+		// Adders with carry lookahead in blocks of 4 bits
+		LookaheadAdder,
+		// Twisted ring of clocked flip-flops
+		ShiftRegister,
+		// Words of latches with a decoder and OR chained bit lines
+		LatchRAM,
+		// Chain of latches halving the clock
+		ClockDivider,
+		// Few lines read by many XOR gates
+		FanoutBus,
+		// Parity of many bits
+		XorTree,
+
+		numTypes
+	};
+
+	extern const char* synthCircuitNames[];
+
 	struct SimulationResult {
 		long long numEventsProcessed;
 		int numTicksProcessed;
 		bool breakpoint;
+		// Id of the bus watch that stopped the simulation. Also sets breakpoint
+		int busWatch = -1;
+
+		// Half ticks run and the most events in one of them
+		int numHalfTicks = 0;
+		int maxHalfTickEvents = 0;
+		// Events that changed the state of their group
+		long long numStateChanges = 0;
+		// Connections followed from groups that changed
+		long long numEdgesTraversed = 0;
+		// Emits dropped because the group was already queued
+		long long numEmitsDeduped = 0;
+
+		// Nanoseconds spent in each part of tick(). Zero unless Project::timePhases is set.
+		// Skipping idle ticks and repeated periods, filling instrument buffers and syncing elided traces
+		long long skipTime = 0;
+		// VMem port and clock ink
+		long long vmemTime = 0;
+		// Starting each half tick: a new queue generation, deferred events and input copies
+		long long queueTime = 0;
+		// Updating groups and notifying their readers
+		long long eventTime = 0;
+		// History, probes, breakpoints and bus watches after each tick
+		long long watchTime = 0;
+	};
+
+	// Totals kept by the event loop during a half tick.
+	// The multithreaded engine keeps one per thread and adds them up after.
+	struct EventTally {
+		uint64_t hash;
+		long long changes;
+		long long edges;
+		long long deduped;
+	};
+
+	enum class BusCondition {
+		// The word equals value
+		Equal,
+		// The word differs from value
+		NotEqual,
+		// The bits in mask equal value
+		Mask,
+		// Any of the bits in mask changed
+		Changed
+	};
+
+	// A word read from a list of groups. See Project::addBusWatch()
+	struct BusWatch {
+		std::string name;
+		// Group of each bit, least significant first. Empty once removed
+		std::vector<int> gids;
+		BusCondition condition;
+		uint64_t value;
+		uint64_t mask;
+		// Word when the bus was last read
+		uint64_t last;
+	};
+
+	// A full copy of the simulation state used to confirm a repeat
+	struct CycleCheckpoint {
+		bool valid;
+		uint64_t hash;
+		unsigned long long tickNum;
+		long long numEvents;
+		unsigned long long clockCounter;
+		uint32_t lastVMemAddr;
+		std::vector<unsigned char> logic;
+		std::vector<int16_t> inputs;
+		// Sorted ids of the pending events
+		std::vector<int> pending;
+		std::vector<int> vmem;
+		// First address of each page in vmem when the project uses a PagedVMem
+		std::vector<uint32_t> vmemAddrs;
+	};
+
+	// Mutable state of a project saved by Project::snapshot().
+	// The graph itself is shared with the project.
+	struct Snapshot {
+		unsigned long long tickNum;
+		unsigned long long clockCounter;
+		uint32_t lastVMemAddr;
+		uint64_t stateHash;
+		uint64_t vmemHash;
+		long long lifetimeEvents;
+		std::vector<unsigned char> logic;
+		std::vector<int16_t> inputs;
+		// Pending events of each bucket
+		std::vector<int> pending;
+		int qSize[(int)Logic::numTypes];
+		// Copies of vmem pages changed since this was taken.
+		// Null pages still match vmem and are copied just before their first write.
+		std::vector<std::shared_ptr<std::vector<int>>> vmemPages;
+		// Pages that are not null
+		std::vector<int> copiedPages;
+		// Copies of PagedVMem pages changed since this was taken, by page number.
+		// Pages missing here still match vmem. Null copies are pages that were never written.
+		std::unordered_map<uint32_t, std::shared_ptr<std::vector<int>>> pagedPages;
+	};
+
+	// Changes made by one tick, or by a run of idle ticks
+	struct TickRecord {
+		// Number of ticks covered. Only idle runs cover more than one
+		unsigned long long ticks;
+		// Set for runs of ticks skipped because nothing was pending
+		bool idle;
+		// Clock counter and vmem address before the first tick
+		unsigned long long clockCounter;
+		uint32_t lastVMemAddr;
+		// Latches toggled from outside just before the tick
+		std::vector<int> toggles;
+		// Groups that flipped in each half tick
+		std::vector<int> flips[2];
+		// VMem address and old ^ new value of each write
+		std::vector<std::pair<uint32_t, uint32_t>> vmemWrites;
+	};
+
+	// Bounded log of recent ticks. See Project::recordHistory()
+	struct History {
+		// Varint encoded tick records. Used as a ring of power of two size
+		std::vector<unsigned char> data;
+		// Byte position where each record starts. Positions only grow.
+		// Used as a ring with one slot per record plus one for the write head.
+		std::vector<unsigned long long> starts;
+		// Oldest and one past the newest record, counted since recording started
+		unsigned long long first;
+		unsigned long long end;
+		// Record and tick within it that the project is at. cursor is end unless rewound.
+		unsigned long long cursor;
+		unsigned long long cursorOffset;
+		// Clock counter and vmem address after the newest record
+		unsigned long long endClockCounter;
+		uint32_t endVMemAddr;
+
+		// Tick being recorded and the flips of the current half tick
+		TickRecord cur;
+		std::vector<int>* curFlips;
+		// Scratch space for encoding and decoding
+		TickRecord scratch[2];
+		std::vector<unsigned char> encoded;
 	};
 
 	class Project {
 	public:
-		int* vmem = nullptr; // null if vmem is not used
+		int* vmem = nullptr; // null if vmem is not used or paged
+		PagedVMem* pagedVMem = nullptr; // used instead of vmem for wide address buses
+		VMemFile* vmemFile = nullptr; // set if vmem is a mapped file
+		bool vmemFromFile = false; // set if vmem was loaded from an existing file by mapVMem()
 		size_t vmemSize = 0;
+		// Widest address bus that still gets a flat vmem array
+		int denseVMemBits = 24;
 		std::string assembly;
 		LatchInterface vmAddr;
 		LatchInterface vmData;
 		uint32_t lastVMemAddr = 0;
+		// Set when a vmem address or data latch flipped since the port was last checked
+		bool vmemDirty = true;
 
 		~Project();
 
@@ -276,8 +673,36 @@ namespace openVCB {
 		// Adjacentcy matrix
 		// By default, the indices from ink groups first and then component groups
 		SparseMat writeMap = {};
+		// Delta encoded copy of writeMap. writeMap.rows is freed when this is used.
+		PackedMat packedMap = {};
+		// Set before preprocess() to delta encode the adjacentcy matrix.
+		// Uses less memory bandwidth on boards with many connections per group.
+		bool usePackedEdges = false;
+#ifdef OVCB_SOA
+		// Stores the logic states of each group
+		unsigned char* stateLogic = nullptr;
+		// Stores the number of active inputs of each group
+		int16_t* stateInputs = nullptr;
+#else
 		// Stores the logic states of each group
 		InkState* states = nullptr;
+#endif
+		// Generation each group was last queued in. 
+		// A group is in the pending queue if this equals epoch.
+		uint32_t* visitEpoch = nullptr;
+		// Generation of the pending queue. Advances every half tick
+		uint32_t epoch = 1;
+		// True if no connection joins two inks or two components.
+		// The engine can then read active inputs in the main loop without a snapshot.
+		bool bipartite = false;
+		// Set before preprocess() to fold away traces with a single writer.
+		// Their readers are connected straight to the writer with delayed connections,
+		// so signals through them no longer cost an event in the trace half tick.
+		// Only used on bipartite boards.
+		bool elideTraces = false;
+		// Elided traces and the group that writes to them, sorted by trace.
+		// Their states are brought up to date at the end of every tick().
+		std::vector<std::pair<int, int>> mirrors;
 		// Stores the actual ink type of each group
 		Ink* stateInks = nullptr;
 
@@ -286,21 +711,102 @@ namespace openVCB {
 		std::unordered_map<long long, long long> lineNumbers;
 		std::vector<InstrumentBuffer> instrumentBuffers;
 		std::map<int, Logic> breakpoints;
+		// Set when a watched group flipped in the current tick
+		bool watchHit = false;
+		// GroupFlag bits of each group
+		std::vector<unsigned char> groupFlags;
+		// Bus watches by id
+		std::vector<BusWatch> busWatches;
+		// Set when a bit of a bus watch flipped in the current tick
+		bool busHit = false;
+		// Probes by id, and the rings they write to.
+		// probeRings is reserved up front so readers on other threads never see it move.
+		std::vector<Probe> probes;
+		std::vector<ProbeRing*> probeRings;
+		static constexpr int maxProbeRings = 64;
+		// Rings that other threads may read. Set once each ring is in probeRings.
+		std::atomic<int> numProbeRings{ 0 };
+		// VCD file being written. Null unless startVCD() was called
+		VCDExport* vcd = nullptr;
+#ifdef OVCB_PROFILE
+		// Activity of each group since preprocess() or resetProfile()
+		std::vector<GroupProfile> profile;
+#endif
 		unsigned long long tickNum = 0;
 
-		// Event queue
+		// Event queue.
+		// Each buffer is split into one bucket per logic type so every 
+		// type can be updated by its own loop.
 		int* updateQ[2]{ nullptr, nullptr };
 		int16_t* lastActiveInputs = nullptr;
+		// Start of each bucket. A bucket holds at most every group of its type
+		int qStart[(int)Logic::numTypes + 1]{};
+
+		// Events sent through delayed connections. Same buckets as updateQ.
+		// Moved into the queue after the next one. Only allocated with elided traces.
+		int* deferQ = nullptr;
 
 #ifdef OVCB_MT
-		std::atomic<int> qSize;
+		// Number of events in each bucket
+		std::atomic<int> qSize[(int)Logic::numTypes]{};
+		std::atomic<int> deferSize[(int)Logic::numTypes]{};
+
+		// Per thread emit queues. One per type followed by one per type for deferQ.
+		// Merged into updateQ[1] and deferQ at the end of each half tick
+		std::vector<std::vector<int>> threadQ;
 #else
-		int qSize;
+		// Number of events in each bucket
+		int qSize[(int)Logic::numTypes]{};
+		int deferSize[(int)Logic::numTypes]{};
 #endif
 
+		// Saved states by id. Deleted ids are null
+		std::vector<Snapshot*> snapshots;
+		// Words per copy on write page of vmem
+		static const int vmemPageSize = 1024;
+		// Set for vmem pages that at least one snapshot still shares with vmem
+		std::vector<unsigned char> vmemPageShared;
+		// PagedVMem pages that every snapshot has its own copy of. The rest may be shared.
+		// Kept the other way around since most of a wide address space is never written.
+		std::unordered_set<uint32_t> pagedVMemCopied;
+
+		// Recorded ticks. Null unless recordHistory() was called
+		History* history = nullptr;
+
+		// Set to skip ahead whole periods once the simulation repeats itself.
+		// Not used while instrument buffers or probes are attached.
+		bool detectCycles = false;
+		// Longest period looked for, in ticks
+		unsigned long long maxCyclePeriod = 1 << 16;
+		// XOR of the keys of every group that is on. Updated by the event loop.
+		// Elided traces are left out.
+		uint64_t stateHash = 0;
+		// XOR of the keys of every vmem word. Updated by vmem writes
+		uint64_t vmemHash = 0;
+		// Events processed since the project was created
+		long long lifetimeEvents = 0;
+		// Last state the simulation is compared against. 
+		// Moved every cycleLimit ticks, which doubles up to maxCyclePeriod.
+		CycleCheckpoint cycleCheckpoint = {};
+		unsigned long long cycleLimit = 1;
+
+		// Number of threads used by the multithreaded engine. 0 uses all cores.
+		// Only used when built with OVCB_MT
+		int numThreads = 0;
+		// Half ticks with fewer events than this run on a single thread
+		int mtMinEvents = 4 * 1024;
+		// Set to fill out the phase times of SimulationResult.
+		// Reads the clock several times per tick, which slows small boards down.
+		bool timePhases = false;
+
 		// Builds a project from an image. Remember to configure VMem
 		void readFromVCB(std::string p);
 
+		// Builds a project from a generated circuit instead of a file. Bits sets the size of
+		// one copy, and copies are tiled until the image holds at least minPixels.
+		// The inputs of each copy are driven by its own clock, so every copy keeps switching.
+		void generateCircuit(SynthCircuit circuit, int bits, long long minPixels = 0);
+
 		// Decode base64 data from clipboard, then process logic data
 		bool readFromBlueprint(std::string clipboardData);
 
@@ -319,6 +825,14 @@ namespace openVCB {
 		// Dump vmem contents to file
 		void dumpVMemToText(std::string p);
 
+		// Maps a file over vmem so its contents persist and can be read by other processes.
+		// A file holding at least vmemSize words is used as the vmem image as is,
+		// and assembleVmem() then only looks up the vmem latches.
+		// Otherwise it is created or grown and the current vmem is copied in.
+		// Writes from tick() go straight to the page cache.
+		// Only works with a flat vmem. Returns false on failure.
+		bool mapVMem(const std::string& path);
+
 		// Toggles the latch at position. 
 		// Does nothing if it's not a latch
 		void toggleLatch(glm::ivec2 pos);
@@ -335,27 +849,374 @@ namespace openVCB {
 		void addBreakpoint(int gid);
 		void removeBreakpoint(int gid);
 
+		// Watches the word on a bus of up to 64 groups, gids[0] being the lowest bit.
+		// tick() stops after any tick that changes the word to one meeting the condition.
+		// Returns the id of the watch.
+		int addBusWatch(const std::string& name, const std::vector<int>& gids,
+			BusCondition condition, uint64_t value = 0, uint64_t mask = ~0ull);
+		void removeBusWatch(int id);
+
+		// Finds a bus watch by name. Returns -1 if there is none
+		int findBusWatch(const std::string& name) const;
+
+		// Reads the current word on a bus
+		uint64_t readBus(const std::vector<int>& gids) const;
+
+		// Creates a ring for probe samples and returns its id.
+		// The ring may be read from another thread while tick() runs.
+		int createProbeRing(size_t capacity = 1 << 16);
+
+		// Returns the ring with the given id, or null if there is none.
+		// Safe to call from the thread reading the ring while tick() runs.
+		ProbeRing* getProbeRing(int ring) const;
+
+		// Streams the changes of a group into a ring as (tick, gid, value) samples,
+		// starting with its current value. Idle groups cost nothing.
+		// With decimation above 1, samples are at least that many ticks apart
+		// and changes in between are folded into the next sample.
+		// Returns the id of the probe.
+		int addProbe(int gid, int ring, int decimation = 1);
+		void removeProbe(int id);
+
+		// Starts writing the signals to a VCD file with one time unit per tick.
+		// Changes are handed to a background thread through a probe ring of
+		// ringSize samples, which formats and writes them while tick() runs.
+		// Returns false if the file could not be opened.
+		bool startVCD(const std::string& path, const std::vector<VCDSignal>& signals, size_t ringSize = 1 << 20);
+
+		// Writes out the remaining changes and closes the VCD file
+		void stopVCD();
+
+		// Changes the current VCD export could not hand over right away because its ring was full.
+		// The file marks where they were lost. Zero if there is no export.
+		unsigned long long vcdDropped() const;
+
+#ifdef OVCB_PROFILE
+		// Zeros the activity counters
+		void resetProfile();
+
+		// Writes totals and the topN groups with the most events to a text file,
+		// with the pixel count and bounding box of each group in the image
+		void writeProfile(const std::string& path, int topN = 100);
+#endif
+
 		// Advances the simulation by n ticks
 		SimulationResult tick(int numTicks = 1, long long maxEvents = 0x7fffffffffffffffll);
 
-		// Emits an event if it is not yet in the queue
-		inline bool tryEmit(int gid) {
-#ifdef OVCB_MT
-			unsigned char expect = 0;
-			// Check if this event is already in queue
-			if (states[gid].visited.compare_exchange_strong(expect, 1, std::memory_order_relaxed)) {
-				updateQ[1][qSize.fetch_add(1, std::memory_order_relaxed)] = gid;
-				return true;
-			}
-			return false;
+		// Saves the current state and returns its id.
+		// Group states are copied. VMem pages are copied once they are written.
+		int snapshot();
+
+		// Returns to a saved state. Only the vmem pages changed since are copied back.
+		// Snapshots stay valid and can be restored any number of times.
+		void restore(int id);
+
+		// Frees a saved state
+		void deleteSnapshot(int id);
+
+		// Starts logging the changes of every tick so they can be stepped through
+		// with rewind() and replay(). The oldest ticks are dropped once the log
+		// holds maxTicks records or maxBytes of data.
+		// Turns off cycle skipping while recording.
+		void recordHistory(size_t maxBytes = 64 << 20, int maxTicks = 1 << 20);
+
+		// Stops recording and frees the log
+		void stopHistory();
+
+		// Steps back up to n ticks. Returns the number of ticks rewound, which is
+		// short of n when the log runs out. The rewound ticks can be replayed
+		// until tick() or toggleLatch() is called.
+		int rewind(int n);
+
+		// Steps forward up to n rewound ticks. Returns the number of ticks replayed
+		int replay(int n);
+
+		// Hash of everything that decides the following ticks
+		uint64_t cycleHash() const;
+
+		// Forgets the cycle checkpoint
+		void resetCycles();
+
+		// Hash of the groups that are on, keyed by their first pixel, and of vmem.
+		// Unlike stateHash it covers elided traces and does not depend on how groups
+		// are numbered, so it can be compared between engine options and builds.
+		uint64_t stateDigest();
+
+		// First pixel of each group in scan order. Made on first use.
+		const std::vector<int>& firstPixels();
+
+		// State accessors. These work with either state layout.
+#ifdef OVCB_SOA
+		inline unsigned char& logicOf(int gid) { return stateLogic[gid]; }
+		inline unsigned char logicOf(int gid) const { return stateLogic[gid]; }
+		inline int16_t& inputsOf(int gid) { return stateInputs[gid]; }
+		inline int16_t inputsOf(int gid) const { return stateInputs[gid]; }
 #else
+		inline unsigned char& logicOf(int gid) { return states[gid].logic; }
+		inline unsigned char logicOf(int gid) const { return states[gid].logic; }
+		inline int16_t& inputsOf(int gid) { return states[gid].activeInputs; }
+		inline int16_t inputsOf(int gid) const { return states[gid].activeInputs; }
+#endif
+		inline bool getVisited(int gid) const { return visitEpoch[gid] == epoch; }
+		inline void setVisited(int gid) { visitEpoch[gid] = epoch; }
+
+		// VMem accessors. These work with either vmem layout.
+		inline bool hasVMem() const { return vmem || pagedVMem; }
+		inline int readVMem(uint32_t addr) const { return vmem ? vmem[addr] : pagedVMem->read(addr); }
+
+		// Gathers the state of a group into an InkState
+		inline InkState getState(int gid) const {
+			return { inputsOf(gid), (unsigned char)getVisited(gid), logicOf(gid) };
+		}
+
+		// Gathers the state of a group as seen from outside the engine.
+		// Unlike getState(), this is also current for elided traces during tick()
+		InkState observedState(int gid) const;
+
+		// Calls f(nxtId, logic type, delayed) on every group written to by gid.
+		// Within a group, outputs are sorted by logic type.
+		template<typename F>
+		inline void forEachOutput(int gid, F f) const {
+			auto visit = [&](int edge) {
+				f(edge & edgeGIDMask, (Logic)((edge >> edgeTypeShift) & edgeTypeMask), edge < 0);
+			};
+
+			if (packedMap.data) {
+				packedMap.forEachRow(gid, visit);
+				return;
+			}
+			for (int r = writeMap.ptr[gid], end = writeMap.ptr[gid + 1]; r < end; r++)
+				visit(writeMap.rows[r]);
+		}
+
+		// Total number of events waiting for the next half tick
+		inline int numPendingEvents() const {
+			int res = 0;
+			for (int t = 0; t < (int)Logic::numTypes; t++)
+				res += qSize[t];
+			return res;
+		}
+
+		// Queues an event for the next half tick if it is not yet queued
+		inline bool pushEvent(int gid) {
+			if (getVisited(gid)) return false;
+			setVisited(gid);
+			const int type = (int)setOff((Logic)logicOf(gid));
+			updateQ[0][qStart[type] + qSize[type]++] = gid;
+			return true;
+		}
+
+		// Emits an event if it is not yet in the queue
+		inline bool tryEmit(int gid, Logic type) {
 			// Check if this event is already in queue
-			if (states[gid].visited) return false;
-			states[gid].visited = 1;
-			updateQ[1][qSize++] = gid;
+			if (getVisited(gid)) return false;
+			setVisited(gid);
+			updateQ[1][qStart[(int)type] + qSize[(int)type]++] = gid;
+			return true;
+		}
+
+		// Emits an event for the half tick after next if it is not yet queued
+		inline bool tryDefer(int gid, Logic type) {
+			if (getVisited(gid)) return false;
+			setVisited(gid);
+			deferQ[qStart[(int)type] + deferSize[(int)type]++] = gid;
 			return true;
-#endif
 		}
+
+#ifdef OVCB_MT
+		// Emits an event into a thread local queue if it is not yet in the queue
+		inline bool tryEmit(int gid, Logic type, std::vector<int>* localQ) {
+			auto& visited = atomicRef(visitEpoch[gid]);
+			// Check before exchanging to keep the cache line shared
+			if (visited.load(std::memory_order_relaxed) == epoch ||
+				visited.exchange(epoch, std::memory_order_relaxed) == epoch)
+				return false;
+			localQ[(int)type].push_back(gid);
+			return true;
+		}
+#endif
+
+	private:
+		// See firstPixels()
+		std::vector<int> groupFirstPixel;
+
+		// Updates every event in the bucket of one logic type
+		template<Logic type, bool multithreaded>
+		void processBucket(int numEvents, std::vector<int>* localQ, EventTally& tally);
+
+		// Updates the state of event i in the current queue and notifies its neighbors
+		template<Logic type, bool multithreaded>
+		void processEvent(int i, std::vector<int>* localQ, EventTally& tally);
+
+		// Notifies the neighbors of a group that just turned on or off
+		template<bool rising, bool multithreaded>
+		void fanOut(int gid, std::vector<int>* localQ, EventTally& tally);
+
+		// Copies the states of written groups into the traces elided from them
+		void syncMirrors();
+
+		// Group whose flips change the observed state of gid.
+		// This is the writer for elided traces and gid itself otherwise.
+		int sourceOf(int gid) const;
+
+		// Sets FlagWatch and FlagBus on the groups that can change a breakpoint or bus watch
+		void updateWatchFlags();
+
+		// Takes the current states as the last seen ones of breakpoints, bus watches and probes
+		void rearmWatches();
+
+		// Checks the breakpoints and bus watches after a tick that flipped one of their groups
+		void checkWatches(SimulationResult& res);
+
+		// Sets FlagProbe on the groups that can change a probe and rebuilds probeIndex
+		void updateProbeFlags();
+
+		// Samples the probes of the groups in probeFlips and the decimated probes now due
+		void captureProbes();
+
+		// Writes a sample if the value of a probe changed since its last one.
+		// Returns false if the ring was full. The probe must then stay pending to try again.
+		bool emitProbe(Probe& probe, unsigned long long tick);
+
+		// Stores a vmem word and keeps the vmem hash and snapshots up to date
+		void writeVMem(uint32_t addr, int data);
+
+		// Appends a record to the history, dropping the oldest ones to make room
+		void pushRecord(TickRecord& rec);
+
+		// Appends a record for idle ticks that just got skipped
+		void recordIdle(unsigned long long ticks);
+
+		// Drops every record after the history cursor
+		void truncateHistory();
+
+		// Decodes record r of the history
+		void readRecord(unsigned long long r, TickRecord& rec) const;
+
+		// Flips every group and vmem word changed by a record.
+		// Undoes the record if it was applied and redoes it otherwise.
+		void applyRecord(const TickRecord& rec);
+
+		// Rebuilds everything not stored in the records at the history cursor
+		void seekHistory();
+
+		// Probe ids by the group whose flips they follow.
+		// Sorted unless probes were added since the last capture.
+		std::vector<std::pair<int, int>> probeIndex;
+		bool probeIndexSorted = true;
+		// Ring used by VCD exports. Kept for the next one
+		int vcdRing = -1;
+		// Groups with FlagProbe that flipped in the current tick
+		std::vector<int> probeFlips;
+		// Ids of decimated probes holding back a change
+		std::vector<int> probesPending;
+
+		// Hands a copy of a vmem page to every snapshot still sharing it.
+		// Call before writing to the page.
+		void copyVMemPage(int page);
+
+		// Unmaps and closes vmemFile without touching vmem
+		void closeVMemFile();
+
+		// Number of upcoming ticks in which no group can change.
+		// These only advance the clock counter.
+		unsigned long long idleTicks() const;
+
+		// Jumps ahead whole periods if the checkpoint state came up again.
+		// Otherwise moves the checkpoint when due.
+		void skipCycles(SimulationResult& res, int numTicks, long long maxEvents);
+
+		// Copies the current state into the cycle checkpoint
+		void saveCheckpoint(uint64_t hash);
+
+		// True if the current state equals the cycle checkpoint
+		bool matchesCheckpoint();
 	};
 
+	/// <summary>
+	/// Bit-sliced batch simulation.
+	/// Runs many independent copies of a preprocessed project at once.
+	/// Every group stores one bit per instance (lane) packed into 64 bit words,
+	/// so one walk over the graph advances all lanes together.
+	/// The graph is shared with the source project and must outlive this.
+	/// </summary>
+	class BatchSim {
+	public:
+		typedef uint64_t LaneWord;
+		static const int laneBits = 64;
+
+		const Project& proj;
+
+		// Number of lanes and 64 bit words per group
+		int numLanes;
+		int numWords;
+
+		// Reverse adjacentcy (inputs of each group)
+		SparseMat readMap = {};
+		// Lane words of each group. Bit set means on.
+		LaneWord* states = nullptr;
+		// Pending toggles of each latch. Mirrors InkState::activeInputs % 2
+		LaneWord* toggles = nullptr;
+		// Next state words for the events in the queue
+		LaneWord* nextStates = nullptr;
+		// How each group combines its inputs. Does not change after preprocess
+		unsigned char* ops = nullptr;
+		// Flags for traversal
+		unsigned char* visited = nullptr;
+
+		// Per lane vmem. Lane l starts at vmem + l * vmemSize
+		int* vmem = nullptr;
+		size_t vmemSize = 0;
+		uint32_t* lastVMemAddr = nullptr;
+
+		unsigned long long clockCounter = 0;
+		unsigned long long clockPeriod = 2;
+		unsigned long long tickNum = 0;
+
+		// Event queue
+		int* updateQ[2]{ nullptr, nullptr };
+		int qSize = 0;
+		// Events sent through delayed connections
+		int* deferQ = nullptr;
+		int deferSize = 0;
+
+		// Forks the current state of proj into numLanes identical lanes
+		BatchSim(const Project& proj, int numLanes = 64);
+		~BatchSim();
+
+		// Toggles the latch at position in one lane. 
+		// Does nothing if it's not a latch
+		void toggleLatch(int lane, glm::ivec2 pos);
+
+		// Toggles the latch in one lane. 
+		// Does nothing if it's not a latch
+		void toggleLatch(int lane, int gid);
+
+		// Gets the active state of a group in one lane
+		inline bool getOn(int lane, int gid) const {
+			return (states[(size_t)gid * numWords + lane / laneBits] >> (lane % laneBits)) & 1;
+		}
+
+		// Gets the vmem of one lane. null if vmem is not used
+		inline int* getVMem(int lane) {
+			return vmem ? vmem + lane * vmemSize : nullptr;
+		}
+
+		// Advances all lanes by n ticks
+		// Events are counted once per group, not once per lane
+		SimulationResult tick(int numTicks = 1, long long maxEvents = 0x7fffffffffffffffll);
+
+	private:
+		inline void emit(int q, int gid) {
+			if (visited[gid]) return;
+			visited[gid] = 1;
+			updateQ[q][qSize++] = gid;
+		}
+
+		inline void defer(int gid) {
+			if (visited[gid]) return;
+			visited[gid] = 1;
+			deferQ[deferSize++] = gid;
+		}
+	};
 }
\ No newline at end of file
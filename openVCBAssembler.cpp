@@ -47,19 +47,23 @@ namespace openVCB {
 	}
 
 	void Project::assembleVmem(char* err) {
-		if (!vmem) return;
+		if (!hasVMem()) return;
+		OVCB_TRACE("assembleVmem");
 		lineNumbers.clear();
 
 		char errBuff[512];
 		// printf("%s\n", assembly.c_str());
 
 		// Scan through everything once to obtain values for labels
+		TraceScope pass("symbols");
 		assemblySymbols.clear();
 		int loc = 1;
 		int lineLoc = 0;
 		int lineNum = 0;
 		char* asmBuffer = (char*)assembly.c_str();
-		while (lineLoc != assembly.size()) {
+		// An image loaded by mapVMem() takes the place of the assembly
+		const size_t asmSize = vmemFromFile ? 0 : assembly.size();
+		while (lineLoc != asmSize) {
 			// Read a line in.
 			string line = getNextLine(asmBuffer, lineLoc, lineNum);
 			if (line.size() == 0) continue;
@@ -87,10 +91,11 @@ namespace openVCB {
 		}
 
 		// Scan through everything again to assemble
+		pass.next("assemble");
 		loc = 1;
 		lineLoc = 0;
 		lineNum = 0;
-		while (lineLoc != assembly.size()) {
+		while (lineLoc != asmSize) {
 			int lNum = lineNum;
 			// Read a line in.
 			string line = getNextLine(asmBuffer, lineLoc, lineNum);
@@ -122,7 +127,7 @@ namespace openVCB {
 
 				addrVal = addrVal % vmemSize;
 				assemblySymbols[label] = addrVal;
-				vmem[addrVal] = val;
+				writeVMem((uint32_t)addrVal, val);
 				lineNumbers[addrVal] = lNum;
 			}
 			else if (prefix(buff, "unpoint")) {
@@ -138,7 +143,7 @@ namespace openVCB {
 
 				// printf("%s (0x%08x=0x%08x)\n", buff, loc, val);
 				auto addrVal = (loc++) % vmemSize;
-				vmem[addrVal] = val;
+				writeVMem((uint32_t)addrVal, val);
 				lineNumbers[addrVal] = lNum;
 			}
 
@@ -152,11 +157,12 @@ namespace openVCB {
 		}
 
 		// Set VMem latch ids
+		pass.next("latches");
 		for (int i = 0; i < vmAddr.numBits; i++) {
 			ivec2 pos = vmAddr.pos + i * vmAddr.stride;
 			vmAddr.gids[i] = indexImage[pos.x + pos.y * width];
 			if (vmAddr.gids[i] == -1 ||
-				setOff((Logic)states[vmAddr.gids[i]].logic) != Logic::LatchOff) {
+				setOff((Logic)logicOf(vmAddr.gids[i])) != Logic::LatchOff) {
 				printf("error: No address latch at VMem position %d %d\n", pos.x, pos.y);
 				exit(-1);
 			}
@@ -165,20 +171,34 @@ namespace openVCB {
 			ivec2 pos = vmData.pos + i * vmData.stride;
 			vmData.gids[i] = indexImage[pos.x + pos.y * width];
 			if (vmAddr.gids[i] == -1 ||
-				setOff((Logic)states[vmData.gids[i]].logic) != Logic::LatchOff) {
+				setOff((Logic)logicOf(vmData.gids[i])) != Logic::LatchOff) {
 				printf("error: No data latch at VMem position %d %d\n", pos.x, pos.y);
 				exit(-1);
 			}
 		}
 
+		// Flips of these wake up the vmem port
+		for (int i = 0; i < vmAddr.numBits; i++)
+			groupFlags[vmAddr.gids[i]] |= FlagVMemPort;
+		for (int i = 0; i < vmData.numBits; i++)
+			groupFlags[vmData.gids[i]] |= FlagVMemPort;
+		vmemDirty = true;
+
 		// dumpVMemToText("vmemDump.bin");
 	}
 
 	void Project::dumpVMemToText(string p) {
 		FILE* file;
 		fopen_s(&file, p.c_str(), "w");
-		for (size_t i = 0; i < vmemSize; i++)
-			fprintf(file, "a: 0x%08x = 0x%08x\n", i, vmem[i]);
+		if (pagedVMem)
+			// Pages never written are all zero
+			pagedVMem->forEachPage([&](uint32_t addr, const int* page) {
+				for (int i = 0; i < PagedVMem::pageSize; i++)
+					fprintf(file, "a: 0x%08x = 0x%08x\n", addr + i, page[i]);
+			});
+		else
+			for (size_t i = 0; i < vmemSize; i++)
+				fprintf(file, "a: 0x%08x = 0x%08x\n", i, vmem[i]);
 		fclose(file);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,323 @@
+// Code for bit-sliced batch simulations
+
+#include "openVCB.h"
+#include <algorithm>
+
+namespace openVCB {
+	using namespace std;
+	using namespace glm;
+
+	// How each group reduces its input lane words
+	enum BatchOp : unsigned char {
+		OpOr,
+		OpNor,
+		OpAnd,
+		OpNand,
+		OpXor,
+		OpXnor,
+		OpLatch,
+		OpClock
+	};
+
+	BatchSim::BatchSim(const Project& proj, int numLanes) : proj(proj) {
+		numWords = std::max(1, (numLanes + laneBits - 1) / laneBits);
+		this->numLanes = numWords * laneBits;
+
+		const int n = proj.writeMap.n;
+		const size_t numStateWords = (size_t)n * numWords;
+
+		// Transpose the write map so each group can gather its inputs
+		readMap.n = n;
+		readMap.nnz = proj.writeMap.nnz;
+		readMap.ptr = new int[n + 1];
+		readMap.rows = new int[readMap.nnz];
+		std::fill(readMap.ptr, readMap.ptr + n + 1, 0);
+		for (int i = 0; i < n; i++)
+			proj.forEachOutput(i, [&](int nxtId, Logic, bool) { readMap.ptr[nxtId + 1]++; });
+		for (int i = 0; i < n; i++)
+			readMap.ptr[i + 1] += readMap.ptr[i];
+
+		std::vector<int> accu(readMap.ptr, readMap.ptr + n);
+		for (int i = 0; i < n; i++)
+			proj.forEachOutput(i, [&](int nxtId, Logic, bool) { readMap.rows[accu[nxtId]++] = i; });
+
+		// Broadcast the current project state to every lane
+		states = new LaneWord[numStateWords];
+		toggles = new LaneWord[numStateWords];
+		nextStates = new LaneWord[numStateWords];
+		ops = new unsigned char[n];
+		visited = new unsigned char[n];
+		for (int i = 0; i < n; i++) {
+			const Logic curLogic = (Logic)proj.logicOf(i);
+			unsigned char op;
+			switch (setOff(curLogic)) {
+			case Logic::ZeroOff:
+				op = setOff(proj.stateInks[i]) == Ink::AndOff ? OpAnd : OpNor;
+				break;
+			case Logic::XorOff:
+				op = OpXor;
+				break;
+			case Logic::XnorOff:
+				op = OpXnor;
+				break;
+			case Logic::LatchOff:
+				op = OpLatch;
+				break;
+			case Logic::ClockOff:
+				op = OpClock;
+				break;
+			default:
+				op = setOff(proj.stateInks[i]) == Ink::NandOff ? OpNand : OpOr;
+			}
+			ops[i] = op;
+			visited[i] = 0;
+
+			const LaneWord state = openVCB::getOn(curLogic) ? ~(LaneWord)0 : 0;
+			const LaneWord toggle = (op == OpLatch && (proj.inputsOf(i) % 2)) ? ~(LaneWord)0 : 0;
+			for (int w = 0; w < numWords; w++) {
+				states[(size_t)i * numWords + w] = state;
+				toggles[(size_t)i * numWords + w] = toggle;
+			}
+		}
+
+		// Copy over pending events
+		updateQ[0] = new int[n];
+		updateQ[1] = new int[n];
+		if (proj.deferQ)
+			deferQ = new int[n];
+		for (int t = 0; t < (int)Logic::numTypes; t++)
+			for (int i = 0; i < proj.qSize[t]; i++)
+				emit(0, proj.updateQ[0][proj.qStart[t] + i]);
+
+		clockCounter = proj.clockCounter;
+		clockPeriod = proj.clockPeriod;
+		tickNum = proj.tickNum;
+
+		if (proj.pagedVMem) {
+			printf("error: Batch simulation needs a flat vmem\n");
+			exit(-1);
+		}
+		if (proj.vmem) {
+			vmemSize = proj.vmemSize;
+			vmem = new int[vmemSize * this->numLanes];
+			lastVMemAddr = new uint32_t[this->numLanes];
+			for (int l = 0; l < this->numLanes; l++) {
+				std::copy(proj.vmem, proj.vmem + vmemSize, vmem + l * vmemSize);
+				lastVMemAddr[l] = proj.lastVMemAddr;
+			}
+		}
+	}
+
+	BatchSim::~BatchSim() {
+		if (readMap.ptr) delete[] readMap.ptr;
+		if (readMap.rows) delete[] readMap.rows;
+		if (states) delete[] states;
+		if (toggles) delete[] toggles;
+		if (nextStates) delete[] nextStates;
+		if (ops) delete[] ops;
+		if (visited) delete[] visited;
+		if (vmem) delete[] vmem;
+		if (lastVMemAddr) delete[] lastVMemAddr;
+		if (updateQ[0]) delete[] updateQ[0];
+		if (updateQ[1]) delete[] updateQ[1];
+		if (deferQ) delete[] deferQ;
+	}
+
+	void BatchSim::toggleLatch(int lane, ivec2 pos) {
+		if (pos.x < 0 || pos.x >= proj.width ||
+			pos.y < 0 || pos.y >= proj.height)
+			return;
+		const int gid = proj.indexImage[pos.x + pos.y * proj.width];
+		toggleLatch(lane, gid);
+	}
+
+	void BatchSim::toggleLatch(int lane, int gid) {
+		if (lane < 0 || lane >= numLanes || gid < 0 || ops[gid] != OpLatch)
+			return;
+		// Same as setting activeInputs to 1 in this lane
+		toggles[(size_t)gid * numWords + lane / laneBits] |= (LaneWord)1 << (lane % laneBits);
+		emit(0, gid);
+	}
+
+	SimulationResult BatchSim::tick(int numTicks, long long maxEvents) {
+		OVCB_TRACE("batch tick", numTicks);
+
+		const LatchInterface& vmAddr = proj.vmAddr;
+		const LatchInterface& vmData = proj.vmData;
+
+		SimulationResult res{};
+		for (; res.numTicksProcessed < numTicks; res.numTicksProcessed++) {
+			if (res.numEventsProcessed > maxEvents) break;
+
+			tickNum++;
+
+			// VMem integration. Each lane has its own address.
+			if (vmem)
+				for (int l = 0; l < numLanes; l++) {
+					const int w = l / laneBits;
+					const LaneWord bit = (LaneWord)1 << (l % laneBits);
+					int* laneVMem = vmem + l * vmemSize;
+
+					// Get current address
+					uint32_t addr = 0;
+					for (int k = 0; k < vmAddr.numBits; k++)
+						addr |= (uint32_t)((states[(size_t)vmAddr.gids[k] * numWords + w] & bit) != 0) << k;
+
+					if (addr != lastVMemAddr[l]) {
+						// Load address
+						lastVMemAddr[l] = addr;
+						int data = laneVMem[addr];
+
+						// Turn on those latches
+						for (int k = 0; k < vmData.numBits; k++) {
+							const int gid = vmData.gids[k];
+							bool isOn = (states[(size_t)gid * numWords + w] & bit) != 0;
+							if (((data >> k) & 1) != isOn) {
+								toggles[(size_t)gid * numWords + w] |= bit;
+								emit(0, gid);
+							}
+						}
+
+						// Force ignore further address updates
+						for (int k = 0; k < vmAddr.numBits; k++)
+							toggles[(size_t)vmAddr.gids[k] * numWords + w] &= ~bit;
+					}
+					else {
+						// Write address
+						int data = 0;
+						for (int k = 0; k < vmData.numBits; k++)
+							data |= (int)((states[(size_t)vmData.gids[k] * numWords + w] & bit) != 0) << k;
+						laneVMem[addr] = data;
+					}
+				}
+
+			// Update the clock ink
+			if (++clockCounter >= clockPeriod)
+				clockCounter = 0;
+			if (clockCounter < 2)
+				for (auto gid : proj.clockGIDs)
+					emit(0, gid);
+
+			for (int traceUpdate = 0; traceUpdate < 2; traceUpdate++) { // We update twice per tick
+				const int numEvents = qSize;
+				res.numEventsProcessed += numEvents;
+				qSize = 0;
+
+				// Release the events held back by elided traces
+				for (int i = 0; i < deferSize; i++)
+					updateQ[1][qSize++] = deferQ[i];
+				deferSize = 0;
+
+				// Evaluate every event against the states of the last half tick
+				for (int i = 0; i < numEvents; i++) {
+					const int gid = updateQ[0][i];
+					visited[gid] = 0;
+
+					LaneWord* next = nextStates + (size_t)i * numWords;
+					LaneWord* cur = states + (size_t)gid * numWords;
+					const int start = readMap.ptr[gid];
+					const int end = readMap.ptr[gid + 1];
+
+					switch (ops[gid]) {
+					case OpOr:
+					case OpNor:
+						for (int w = 0; w < numWords; w++)
+							next[w] = 0;
+						for (int r = start; r < end; r++) {
+							const LaneWord* src = states + (size_t)readMap.rows[r] * numWords;
+							for (int w = 0; w < numWords; w++)
+								next[w] |= src[w];
+						}
+						break;
+
+					case OpAnd:
+					case OpNand:
+						for (int w = 0; w < numWords; w++)
+							next[w] = ~(LaneWord)0;
+						for (int r = start; r < end; r++) {
+							const LaneWord* src = states + (size_t)readMap.rows[r] * numWords;
+							for (int w = 0; w < numWords; w++)
+								next[w] &= src[w];
+						}
+						break;
+
+					case OpXor:
+					case OpXnor:
+						for (int w = 0; w < numWords; w++)
+							next[w] = 0;
+						for (int r = start; r < end; r++) {
+							const LaneWord* src = states + (size_t)readMap.rows[r] * numWords;
+							for (int w = 0; w < numWords; w++)
+								next[w] ^= src[w];
+						}
+						break;
+
+					case OpLatch: {
+						LaneWord* toggle = toggles + (size_t)gid * numWords;
+						for (int w = 0; w < numWords; w++) {
+							next[w] = cur[w] ^ toggle[w];
+							toggle[w] = 0;
+						}
+						break;
+					}
+
+					case OpClock:
+						for (int w = 0; w < numWords; w++)
+							next[w] = clockCounter == 0 ? ~(LaneWord)0 : 0;
+						break;
+					}
+
+					// Inverting gates
+					if (ops[gid] == OpNor || ops[gid] == OpNand || ops[gid] == OpXnor)
+						for (int w = 0; w < numWords; w++)
+							next[w] = ~next[w];
+				}
+
+				// Commit the new states and notify neighbors
+				for (int i = 0; i < numEvents; i++) {
+					const int gid = updateQ[0][i];
+					const LaneWord* next = nextStates + (size_t)i * numWords;
+					LaneWord* cur = states + (size_t)gid * numWords;
+
+					LaneWord changed = 0;
+					LaneWord rising = 0;
+					for (int w = 0; w < numWords; w++) {
+						changed |= next[w] ^ cur[w];
+						rising |= next[w] & ~cur[w];
+					}
+
+					// Short circuit if no lane changed
+					if (!changed) continue;
+
+					// Loop over neighbors
+					proj.forEachOutput(gid, [&](int nxtId, Logic nxtInk, bool delayed) {
+						// Latches only see rising edges
+						if (nxtInk == Logic::LatchOff) {
+							if (!rising) return;
+							LaneWord* toggle = toggles + (size_t)nxtId * numWords;
+							for (int w = 0; w < numWords; w++)
+								toggle[w] ^= next[w] & ~cur[w];
+						}
+
+						if (delayed)
+							defer(nxtId);
+						else
+							emit(1, nxtId);
+					});
+
+					for (int w = 0; w < numWords; w++)
+						cur[w] = next[w];
+				}
+
+				// Swap buffer
+				std::swap(updateQ[0], updateQ[1]);
+			}
+		}
+
+		// Elided traces mirror their writer
+		for (auto& m : proj.mirrors)
+			std::copy(states + (size_t)m.second * numWords, states + (size_t)(m.second + 1) * numWords,
+				states + (size_t)m.first * numWords);
+		return res;
+	}
+}
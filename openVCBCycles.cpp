@@ -0,0 +1,122 @@
+// Code for detecting and skipping repeating states
+
+#include "openVCB.h"
+#include <algorithm>
+
+namespace openVCB {
+	using namespace std;
+	using namespace glm;
+
+	uint64_t Project::cycleHash() const {
+		// Pending events and their inputs. 
+		// Every other input count follows from the states.
+		uint64_t queueHash = 0;
+		for (int t = 0; t < (int)Logic::numTypes; t++)
+			for (int i = qStart[t], end = qStart[t] + qSize[t]; i < end; i++) {
+				const int gid = updateQ[0][i];
+				queueHash ^= hashKey(((uint64_t)gid << 16) | (uint16_t)inputsOf(gid));
+			}
+
+		const uint64_t rest = hashKey(clockCounter) ^ hashKey(((uint64_t)lastVMemAddr << 1) | 1);
+		return stateHash ^ (vmemHash * 3) ^ (queueHash * 5) ^ rest;
+	}
+
+	void Project::resetCycles() {
+		cycleCheckpoint.valid = false;
+		cycleLimit = 1;
+	}
+
+	void Project::saveCheckpoint(uint64_t hash) {
+		if (mirrors.size())
+			syncMirrors();
+
+		CycleCheckpoint& cp = cycleCheckpoint;
+		cp.valid = true;
+		cp.hash = hash;
+		cp.tickNum = tickNum;
+		cp.numEvents = lifetimeEvents;
+		cp.clockCounter = clockCounter;
+		cp.lastVMemAddr = lastVMemAddr;
+
+		cp.logic.resize(numGroups);
+		cp.inputs.resize(numGroups);
+		for (int i = 0; i < numGroups; i++) {
+			cp.logic[i] = logicOf(i);
+			cp.inputs[i] = inputsOf(i);
+		}
+
+		cp.pending.clear();
+		for (int t = 0; t < (int)Logic::numTypes; t++)
+			cp.pending.insert(cp.pending.end(), updateQ[0] + qStart[t], updateQ[0] + qStart[t] + qSize[t]);
+		std::sort(cp.pending.begin(), cp.pending.end());
+
+		if (vmem)
+			cp.vmem.assign(vmem, vmem + vmemSize);
+		else if (pagedVMem)
+			pagedVMem->save(cp.vmemAddrs, cp.vmem);
+		else
+			cp.vmem.clear();
+	}
+
+	bool Project::matchesCheckpoint() {
+		const CycleCheckpoint& cp = cycleCheckpoint;
+		if (clockCounter != cp.clockCounter || lastVMemAddr != cp.lastVMemAddr ||
+			numPendingEvents() != (int)cp.pending.size())
+			return false;
+
+		if (mirrors.size())
+			syncMirrors();
+		for (int i = 0; i < numGroups; i++)
+			if (logicOf(i) != cp.logic[i] || inputsOf(i) != cp.inputs[i])
+				return false;
+
+		std::vector<int> pending;
+		pending.reserve(cp.pending.size());
+		for (int t = 0; t < (int)Logic::numTypes; t++)
+			pending.insert(pending.end(), updateQ[0] + qStart[t], updateQ[0] + qStart[t] + qSize[t]);
+		std::sort(pending.begin(), pending.end());
+		if (pending != cp.pending)
+			return false;
+
+		if (pagedVMem)
+			return pagedVMem->equals(cp.vmemAddrs, cp.vmem);
+		return !vmem || std::equal(vmem, vmem + vmemSize, cp.vmem.begin());
+	}
+
+	void Project::skipCycles(SimulationResult& res, int numTicks, long long maxEvents) {
+		const uint64_t hash = cycleHash();
+		CycleCheckpoint& cp = cycleCheckpoint;
+
+		if (!cp.valid) {
+			saveCheckpoint(hash);
+			return;
+		}
+
+		const unsigned long long period = tickNum - cp.tickNum;
+		if (period > 0 && hash == cp.hash && matchesCheckpoint()) {
+			// Everything from here repeats the last period exactly
+			const long long periodEvents = lifetimeEvents - cp.numEvents;
+			long long numPeriods = (numTicks - res.numTicksProcessed) / period;
+			if (periodEvents > 0)
+				numPeriods = std::min(numPeriods, (maxEvents - res.numEventsProcessed) / periodEvents);
+			if (numPeriods <= 0) return;
+
+			tickNum += numPeriods * period;
+			lifetimeEvents += numPeriods * periodEvents;
+			res.numTicksProcessed += (int)(numPeriods * period);
+			res.numEventsProcessed += numPeriods * periodEvents;
+
+			// Keep the checkpoint one period behind
+			cp.tickNum = tickNum - period;
+			cp.numEvents = lifetimeEvents - periodEvents;
+			return;
+		}
+
+		// Brent's method. Moving the checkpoint at growing intervals
+		// finds any period up to cycleLimit once the loop is entered.
+		if (period >= cycleLimit) {
+			saveCheckpoint(hash);
+			cycleLimit = std::min(cycleLimit * 2, std::max(maxCyclePeriod, 1ull));
+		}
+	}
+}
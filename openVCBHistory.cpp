@@ -0,0 +1,351 @@
+// Code for recording ticks and stepping back through them
+
+#include "openVCB.h"
+#include <algorithm>
+
+namespace openVCB {
+	using namespace std;
+	using namespace glm;
+
+	static void putVarint(std::vector<unsigned char>& out, unsigned long long v) {
+		while (v >= 0x80) {
+			out.push_back((unsigned char)(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back((unsigned char)v);
+	}
+
+	// Gids are stored as a count followed by the zigzag encoded steps between them.
+	// Queues mostly run in gid order so the steps stay short without sorting.
+	static void putGIDs(std::vector<unsigned char>& out, const std::vector<int>& gids) {
+		putVarint(out, gids.size());
+		int last = 0;
+		for (int gid : gids) {
+			const int step = gid - last;
+			putVarint(out, ((unsigned int)step << 1) ^ (unsigned int)(step >> 31));
+			last = gid;
+		}
+	}
+
+	// Reads varints from the history ring
+	struct RingReader {
+		const unsigned char* data;
+		size_t mask;
+		unsigned long long pos;
+
+		unsigned long long varint() {
+			unsigned long long v = 0;
+			for (int shift = 0;; shift += 7) {
+				const unsigned char b = data[pos++ & mask];
+				v |= (unsigned long long)(b & 0x7f) << shift;
+				if (!(b & 0x80)) return v;
+			}
+		}
+
+		void gids(std::vector<int>& out) {
+			out.resize(varint());
+			int last = 0;
+			for (auto& gid : out) {
+				const unsigned int step = (unsigned int)varint();
+				gid = last += (int)(step >> 1) ^ -(int)(step & 1);
+			}
+		}
+	};
+
+	void Project::recordHistory(size_t maxBytes, int maxTicks) {
+		if (!history)
+			history = new History();
+		History& h = *history;
+
+		// Round up to a power of two so positions wrap with a mask
+		size_t size = 1;
+		while (size < maxBytes)
+			size <<= 1;
+		h.data.assign(size, 0);
+		h.starts.assign((size_t)std::max(maxTicks, 1) + 1, 0);
+
+		h.first = h.end = h.cursor = 0;
+		h.cursorOffset = 0;
+		h.endClockCounter = clockCounter;
+		h.endVMemAddr = lastVMemAddr;
+
+		h.cur.toggles.clear();
+		h.cur.flips[0].clear();
+		h.cur.flips[1].clear();
+		h.cur.vmemWrites.clear();
+		h.curFlips = &h.cur.flips[0];
+	}
+
+	void Project::stopHistory() {
+		if (history) delete history;
+		history = nullptr;
+	}
+
+	void Project::pushRecord(TickRecord& rec) {
+		History& h = *history;
+		std::vector<unsigned char>& out = h.encoded;
+
+		out.clear();
+		putVarint(out, rec.ticks << 1 | (unsigned long long)rec.idle);
+		putVarint(out, rec.clockCounter);
+		putVarint(out, rec.lastVMemAddr);
+		putGIDs(out, rec.toggles);
+		putGIDs(out, rec.flips[0]);
+		putGIDs(out, rec.flips[1]);
+		putVarint(out, rec.vmemWrites.size());
+		for (auto& w : rec.vmemWrites) {
+			putVarint(out, w.first);
+			putVarint(out, w.second);
+		}
+
+		const size_t numSlots = h.starts.size();
+		const unsigned long long head = h.starts[h.end % numSlots];
+		if (out.size() > h.data.size()) {
+			// Too large to keep. Nothing before it can be rewound to either.
+			h.end++;
+			h.first = h.end;
+			h.starts[h.end % numSlots] = head;
+		}
+		else {
+			// Drop the oldest records until this one fits
+			while (h.end - h.first >= numSlots - 1 ||
+				head + out.size() - h.starts[h.first % numSlots] > h.data.size())
+				h.first++;
+
+			const size_t mask = h.data.size() - 1;
+			for (size_t i = 0; i < out.size(); i++)
+				h.data[(head + i) & mask] = out[i];
+			h.end++;
+			h.starts[h.end % numSlots] = head + out.size();
+		}
+
+		h.cursor = h.end;
+		h.cursorOffset = 0;
+		h.endClockCounter = clockCounter;
+		h.endVMemAddr = lastVMemAddr;
+
+		rec.toggles.clear();
+		rec.flips[0].clear();
+		rec.flips[1].clear();
+		rec.vmemWrites.clear();
+	}
+
+	void Project::recordIdle(unsigned long long ticks) {
+		TickRecord& rec = history->scratch[0];
+		rec.ticks = ticks;
+		rec.idle = true;
+		rec.clockCounter = (clockCounter + clockPeriod - ticks % clockPeriod) % clockPeriod;
+		rec.lastVMemAddr = lastVMemAddr;
+		rec.toggles.clear();
+		rec.flips[0].clear();
+		rec.flips[1].clear();
+		rec.vmemWrites.clear();
+		pushRecord(rec);
+	}
+
+	void Project::truncateHistory() {
+		History& h = *history;
+		if (h.cursor == h.end)
+			return;
+
+		// Toggles made at the end of the log belong to the dropped ticks
+		h.cur.toggles.clear();
+
+		const unsigned long long offset = h.cursorOffset;
+		h.end = h.cursor;
+		h.cursorOffset = 0;
+		h.endClockCounter = clockCounter;
+		h.endVMemAddr = lastVMemAddr;
+
+		// Keep the part of an idle run that was already played
+		if (offset) {
+			TickRecord& rec = h.scratch[0];
+			readRecord(h.end, rec);
+			rec.ticks = offset;
+			pushRecord(rec);
+		}
+	}
+
+	void Project::readRecord(unsigned long long r, TickRecord& rec) const {
+		RingReader in{ history->data.data(), history->data.size() - 1, history->starts[r % history->starts.size()] };
+
+		const unsigned long long ticks = in.varint();
+		rec.ticks = ticks >> 1;
+		rec.idle = ticks & 1;
+		rec.clockCounter = in.varint();
+		rec.lastVMemAddr = (uint32_t)in.varint();
+		in.gids(rec.toggles);
+		in.gids(rec.flips[0]);
+		in.gids(rec.flips[1]);
+		rec.vmemWrites.resize(in.varint());
+		for (auto& w : rec.vmemWrites) {
+			w.first = (uint32_t)in.varint();
+			w.second = (uint32_t)in.varint();
+		}
+	}
+
+	void Project::applyRecord(const TickRecord& rec) {
+		for (int half = 0; half < 2; half++)
+			for (int gid : rec.flips[half]) {
+				const bool on = !getOn((Logic)logicOf(gid));
+				logicOf(gid) = (unsigned char)setOn((Logic)logicOf(gid), on);
+				stateHash ^= hashKey(gid);
+
+				// Latch inputs only count pending toggles. seekHistory() rebuilds those.
+				forEachOutput(gid, [&](int nxtId, Logic nxtInk, bool) {
+					if (nxtInk != Logic::LatchOff)
+						inputsOf(nxtId) += on ? 1 : -1;
+				});
+			}
+
+		for (auto& w : rec.vmemWrites)
+			writeVMem(w.first, readVMem(w.first) ^ (int)w.second);
+	}
+
+	void Project::seekHistory() {
+		History& h = *history;
+
+		// Drop the pending events. Pending latches hold their toggles in their inputs.
+		for (int t = 0; t < (int)Logic::numTypes; t++) {
+			if (t == (int)Logic::LatchOff)
+				for (int i = 0; i < qSize[t]; i++)
+					inputsOf(updateQ[0][qStart[t] + i]) = 0;
+			qSize[t] = 0;
+		}
+		if (++epoch == 0) {
+			std::fill(visitEpoch, visitEpoch + numGroups, 0);
+			epoch = 1;
+		}
+
+		// Find the record of the next tick. Idle runs start with nothing pending.
+		const TickRecord* next = nullptr;
+		if (h.cursor == h.end) {
+			clockCounter = h.endClockCounter;
+			lastVMemAddr = h.endVMemAddr;
+			next = &h.cur;
+		}
+		else {
+			TickRecord& rec = h.scratch[0];
+			readRecord(h.cursor, rec);
+			clockCounter = (rec.clockCounter + h.cursorOffset) % clockPeriod;
+			lastVMemAddr = rec.lastVMemAddr;
+			if (!h.cursorOffset && !rec.idle)
+				next = &rec;
+		}
+
+		if (next && h.cursor > h.first) {
+			TickRecord& prev = h.scratch[1];
+			readRecord(h.cursor - 1, prev);
+
+			// Queue up everything the last tick emitted. This may queue a few groups
+			// that the engine skipped, which is harmless as their state already agrees with their inputs.
+			auto emitFrom = [&](int gid, bool wantDelayed) {
+				const bool on = getOn((Logic)logicOf(gid));
+				forEachOutput(gid, [&](int nxtId, Logic nxtInk, bool delayed) {
+					if (delayed != wantDelayed)
+						return;
+					if (nxtInk == Logic::LatchOff) {
+						if (!on) return;
+						inputsOf(nxtId)++;
+					}
+					pushEvent(nxtId);
+				});
+			};
+			if (!prev.idle) {
+				for (int gid : prev.flips[1])
+					emitFrom(gid, false);
+				for (int gid : prev.flips[0])
+					emitFrom(gid, true);
+			}
+		}
+
+		// Toggles made just before the next tick
+		if (next)
+			for (int gid : next->toggles) {
+				inputsOf(gid) = 1;
+				pushEvent(gid);
+			}
+
+		vmemDirty = true;
+		if (mirrors.size())
+			syncMirrors();
+
+		// Breakpoints compare against the state we moved to
+		rearmWatches();
+		resetCycles();
+	}
+
+	int Project::rewind(int n) {
+		if (!history)
+			return 0;
+		History& h = *history;
+
+		int count = 0;
+		while (count < n) {
+			// Step back inside an idle run
+			if (h.cursorOffset) {
+				const int step = (int)std::min((unsigned long long)(n - count), h.cursorOffset);
+				h.cursorOffset -= step;
+				count += step;
+				continue;
+			}
+			if (h.cursor == h.first)
+				break;
+
+			TickRecord& rec = h.scratch[0];
+			readRecord(h.cursor - 1, rec);
+			if (rec.idle) {
+				const int step = (int)std::min((unsigned long long)(n - count), rec.ticks);
+				h.cursor--;
+				h.cursorOffset = rec.ticks - step;
+				count += step;
+			}
+			else {
+				// The events pending before this tick are rebuilt from the tick before it
+				if (h.cursor - 1 == h.first)
+					break;
+				applyRecord(rec);
+				h.cursor--;
+				count++;
+			}
+		}
+
+		if (count) {
+			tickNum -= count;
+			seekHistory();
+		}
+		return count;
+	}
+
+	int Project::replay(int n) {
+		if (!history)
+			return 0;
+		History& h = *history;
+
+		int count = 0;
+		while (count < n && h.cursor != h.end) {
+			TickRecord& rec = h.scratch[0];
+			readRecord(h.cursor, rec);
+			if (rec.idle) {
+				const int step = (int)std::min((unsigned long long)(n - count), rec.ticks - h.cursorOffset);
+				h.cursorOffset += step;
+				count += step;
+				if (h.cursorOffset == rec.ticks) {
+					h.cursor++;
+					h.cursorOffset = 0;
+				}
+			}
+			else {
+				applyRecord(rec);
+				h.cursor++;
+				count++;
+			}
+		}
+
+		if (count) {
+			tickNum += count;
+			seekHistory();
+		}
+		return count;
+	}
+}
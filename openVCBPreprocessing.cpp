@@ -92,8 +92,98 @@ namespace openVCB {
 		}
 	}
 
+	// True for the groups that carry signals between components
+	inline bool isTrace(Ink ink) {
+		return ink == Ink::TraceOff || ink == Ink::BundleOff;
+	}
+
+	// Replaces every trace with exactly one writer by connections from that writer
+	// to each of its readers. Duplicate connections are kept so input counts stay the same.
+	// Expects a bipartite graph so the writer is always a component.
+	void elideTraceGroups(std::vector<std::pair<int, int>>& conList, const Ink* stateInks, int n,
+		std::vector<std::pair<int, int>>& mirrors) {
+		std::vector<int> numWriters(n, 0);
+		std::vector<int> writer(n, -1);
+		for (auto e : conList) {
+			numWriters[e.second]++;
+			writer[e.second] = e.first;
+		}
+
+		std::vector<bool> elided(n);
+		for (int i = 0; i < n; i++)
+			if (isTrace(stateInks[i]) && numWriters[i] == 1) {
+				elided[i] = true;
+				mirrors.push_back({ i, writer[i] });
+			}
+		if (mirrors.empty()) return;
+
+		// Readers of each elided trace
+		std::vector<int> ptr(n + 1, 0);
+		for (auto e : conList)
+			if (elided[e.first])
+				ptr[e.first + 1]++;
+		for (int i = 0; i < n; i++)
+			ptr[i + 1] += ptr[i];
+		std::vector<int> readers(ptr[n]);
+		std::vector<int> accu(ptr.begin(), ptr.end() - 1);
+		for (auto e : conList)
+			if (elided[e.first])
+				readers[accu[e.first]++] = e.second;
+
+		std::vector<std::pair<int, int>> newList;
+		newList.reserve(conList.size());
+		for (auto e : conList) {
+			if (elided[e.first]) continue;
+			if (elided[e.second]) {
+				for (int r = ptr[e.second]; r < ptr[e.second + 1]; r++)
+					newList.push_back({ e.first, readers[r] });
+			}
+			else
+				newList.push_back(e);
+		}
+		conList.swap(newList);
+	}
+
+	// Delta encodes a matrix with sorted rows
+	void packMatrix(const SparseMat& mat, PackedMat& packed) {
+		packed.n = mat.n;
+		packed.nnz = mat.nnz;
+		packed.index = new int[2 * mat.n + 2];
+
+		std::vector<uint16_t> data;
+		data.reserve(mat.nnz);
+		for (int i = 0; i < mat.n; i++) {
+			const int start = mat.ptr[i];
+			const int end = mat.ptr[i + 1];
+			packed.index[2 * i] = (int)data.size();
+			packed.index[2 * i + 1] = start < end ? mat.rows[start] : -1;
+
+			for (int r = start + 1; r < end; r++) {
+				// Unsigned so delayed connections cannot overflow this
+				const uint32_t gap = (uint32_t)mat.rows[r] - (uint32_t)mat.rows[r - 1];
+				if (gap < 0xffff)
+					data.push_back((uint16_t)gap);
+				else {
+					// Outlier. Store the full row instead
+					data.push_back(0xffff);
+					data.push_back((uint16_t)(mat.rows[r] & 0xffff));
+					data.push_back((uint16_t)((uint32_t)mat.rows[r] >> 16));
+				}
+			}
+		}
+		packed.index[2 * mat.n] = (int)data.size();
+		packed.index[2 * mat.n + 1] = -1;
+
+		packed.dataSize = data.size();
+		packed.data = new uint16_t[std::max((size_t)1, data.size())];
+		std::copy(data.begin(), data.end(), packed.data);
+	}
+
 	void Project::preprocess(bool useGorder) {
+		OVCB_TRACE("preprocess");
+
 		// Turn off any inks that start as off
+		TraceScope stage("reset inks");
 #pragma omp parallel for schedule(static, 8192)
 		for (int i = 0; i < width * height; i++) {
 			Ink ink = (Ink)image[i].ink;
@@ -117,6 +207,7 @@ namespace openVCB {
 			}
 		}
 
+		stage.next("flood fill");
 		std::vector<int> visited(width * height, 0);
 		std::vector<ivec2> stack;
 		std::vector<ivec2> bundleStack;
@@ -254,6 +345,7 @@ namespace openVCB {
 		numGroups = writeMap.n;
 
 		// Sort groups by ink vs. component then by morton code.
+		stage.next("sort groups");
 		std::sort(indexDict.begin(), indexDict.end(),
 			[](const Group& a, const Group& b) -> bool {
 				if (std::get<2>(a) == std::get<2>(b))
@@ -263,7 +355,19 @@ namespace openVCB {
 
 		// List of connections
 		// Build state vector
-		states = new InkState[writeMap.n];
+		stage.next("group states");
+#ifdef OVCB_SOA
+		stateLogic = new unsigned char[writeMap.n];
+		stateInputs = new int16_t[writeMap.n];
+#else
+		states = new InkState[writeMap.n]();
+#endif
+		visitEpoch = new uint32_t[writeMap.n]();
+		epoch = 1;
+		groupFlags.assign(writeMap.n, 0);
+#ifdef OVCB_PROFILE
+		profile.assign(writeMap.n, {});
+#endif
 		stateInks = new Ink[writeMap.n];
 		// Borrow writeMap for a reverse mapping
 		writeMap.ptr = new int[writeMap.n + 1];
@@ -272,10 +376,8 @@ namespace openVCB {
 
 			stateInks[i] = std::get<2>(g);
 
-			InkState& s = states[i];
-			s.logic = (unsigned char)std::get<1>(g);
-			s.visited = 0;
-			s.activeInputs = 0;
+			logicOf(i) = (unsigned char)std::get<1>(g);
+			inputsOf(i) = 0;
 
 			writeMap.ptr[std::get<0>(g)] = i;
 		}
@@ -291,6 +393,7 @@ namespace openVCB {
 		// printf("Found %d read inks and %d write inks.\n", readInks.size(), writeInks.size());
 
 		// Hash sets to keep track of unique connections
+		stage.next("edges");
 		unordered_set<long long> conSet;
 		std::vector<std::pair<int, int>> conList;
 		// Add connections from inks to components
@@ -348,10 +451,21 @@ namespace openVCB {
 		}
 		size_t numComp2Write = conSet.size();
 
+		// Check if signals always alternate between inks and components
+		bipartite = true;
+		for (auto e : conList) {
+			if (isTrace(stateInks[e.first]) == isTrace(stateInks[e.second])) {
+				bipartite = false;
+				break;
+			}
+		}
+		stage.end();
+
 		// printf("Found %zd ink->comp and %zd comp->ink connections (%d total).\n", numRead2Comp, numComp2Write, numRead2Comp + numComp2Write);
 
 		// Gorder
 		if (useGorder) {
+			OVCB_TRACE("gorder");
 			Gorder::Graph g;
 			vector<pair<int, int>> list(conList);
 			g.readGraph(list, writeMap.n);
@@ -362,11 +476,16 @@ namespace openVCB {
 			std::vector<int> order;
 			g.GorderGreedy(order, 64);
 
-			auto oldStates = states;
-			states = new InkState[writeMap.n];
+			vector<InkState> oldStates(writeMap.n);
+			vector<Ink> oldInks(stateInks, stateInks + writeMap.n);
 			for (int i = 0; i < writeMap.n; i++)
-				states[order[transformOrder[i]]] = oldStates[i];
-			delete[] oldStates;
+				oldStates[i] = getState(i);
+			for (int i = 0; i < writeMap.n; i++) {
+				const int j = order[transformOrder[i]];
+				logicOf(j) = oldStates[i].logic;
+				inputsOf(j) = oldStates[i].activeInputs;
+				stateInks[j] = oldInks[i];
+			}
 
 			for (size_t i = 0; i < conList.size(); i++) {
 				auto edge = conList[i];
@@ -382,11 +501,28 @@ namespace openVCB {
 			}
 		}
 
+		// Fold away traces with a single writer
+		mirrors.clear();
+		if (elideTraces && bipartite) {
+			OVCB_TRACE("elide traces");
+			elideTraceGroups(conList, stateInks, writeMap.n, mirrors);
+
+			// Components now write to components within the same half tick
+			if (mirrors.size())
+				bipartite = false;
+		}
+
 		// Stores rows per colume.
+		stage.next("csr");
 		std::vector<int> accu(writeMap.n, 0);
 		for (auto e : conList)
 			accu[e.first]++;
 
+		if (writeMap.n > edgeGIDMask) {
+			printf("error: %d groups is more than the %d supported\n", writeMap.n, edgeGIDMask);
+			exit(-1);
+		}
+
 		// Construct adjacentcy matrix
 		writeMap.nnz = conList.size();
 		writeMap.ptr[writeMap.n] = writeMap.nnz;
@@ -408,22 +544,50 @@ namespace openVCB {
 			Ink dstInk = stateInks[con.second];
 			if (dstInk == Ink::AndOff ||
 				dstInk == Ink::NandOff)
-				states[con.second].activeInputs--;
-
-			writeMap.rows[writeMap.ptr[con.first] + (accu[con.first]++)] = con.second;
+				inputsOf(con.second)--;
+
+			// Tag with the target type
+			int tag = (int)setOff((Logic)logicOf(con.second)) << edgeTypeShift;
+			// Connections between components only exist where a trace was elided
+			if (mirrors.size() && !isTrace(stateInks[con.first]) && !isTrace(stateInks[con.second]))
+				tag |= edgeDelayBit;
+			writeMap.rows[writeMap.ptr[con.first] + (accu[con.first]++)] = con.second | tag;
 		}
 
-		// Sort rows
+		// Sort rows. This also groups them by target type
+		stage.next("sort rows");
 		for (int i = 0; i < writeMap.n; i++) {
 			int start = writeMap.ptr[i];
 			int end = writeMap.ptr[i + 1];
 			std::sort(&writeMap.rows[start], &writeMap.rows[end]);
 		}
+		stage.end();
+
+		// Swap in the delta encoded matrix
+		if (usePackedEdges) {
+			OVCB_TRACE("pack edges");
+			packMatrix(writeMap, packedMap);
+			delete[] writeMap.rows;
+			writeMap.rows = nullptr;
+		}
 
+		stage.next("queues");
 		updateQ[0] = new int[writeMap.n];
 		updateQ[1] = new int[writeMap.n];
 		lastActiveInputs = new int16_t[writeMap.n];
-		qSize = 0;
+		if (mirrors.size())
+			deferQ = new int[writeMap.n];
+
+		// Size the queue buckets by the number of groups of each logic type
+		for (int t = 0; t <= (int)Logic::numTypes; t++)
+			qStart[t] = 0;
+		for (int i = 0; i < writeMap.n; i++)
+			qStart[(int)setOff((Logic)logicOf(i)) + 1]++;
+		for (int t = 0; t < (int)Logic::numTypes; t++) {
+			qStart[t + 1] += qStart[t];
+			qSize[t] = 0;
+			deferSize[t] = 0;
+		}
 
 		// Insert starting events into the queue
 		for (size_t i = 0; i < writeMap.n; i++) {
@@ -433,13 +597,13 @@ namespace openVCB {
 				ink == Ink::NandOff ||
 				ink == Ink::XnorOff ||
 				ink == Ink::Latch)
-				updateQ[0][qSize++] = i;
+				pushEvent(i);
 
 			if (ink == Ink::ClockOff)
 				clockGIDs.push_back(i);
 
 			if (ink == Ink::Latch)
-				states[i].activeInputs = 1;
+				inputsOf(i) = 1;
 		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,133 @@
+// Code for streaming group changes to probe rings
+
+#include "openVCB.h"
+#include <algorithm>
+
+namespace openVCB {
+	using namespace std;
+	using namespace glm;
+
+	int Project::createProbeRing(size_t capacity) {
+		if ((int)probeRings.size() >= maxProbeRings) {
+			printf("error: Projects can have at most %d probe rings\n", maxProbeRings);
+			return -1;
+		}
+		if (probeRings.capacity() < (size_t)maxProbeRings)
+			probeRings.reserve(maxProbeRings);
+		probeRings.push_back(new ProbeRing(std::max(capacity, (size_t)1)));
+		numProbeRings.store((int)probeRings.size(), std::memory_order_release);
+		return (int)probeRings.size() - 1;
+	}
+
+	ProbeRing* Project::getProbeRing(int ring) const {
+		if (ring < 0 || ring >= numProbeRings.load(std::memory_order_acquire))
+			return nullptr;
+		return probeRings.data()[ring];
+	}
+
+	int Project::addProbe(int gid, int ring, int decimation) {
+		if (gid < 0 || gid >= numGroups || ring < 0 || ring >= (int)probeRings.size())
+			return -1;
+
+		Probe probe{ gid, ring, std::max(decimation, 1), false, 0, false, false };
+		// Start the stream with the current value
+		probe.last = !getOn((Logic)observedState(gid).logic);
+		if (!emitProbe(probe, tickNum)) {
+			probe.pending = true;
+			probesPending.push_back((int)probes.size());
+		}
+
+		// probeIndex is sorted again before the next capture
+		const int src = sourceOf(gid);
+		groupFlags[src] |= FlagProbe;
+		probeIndex.push_back({ src, (int)probes.size() });
+		probeIndexSorted = false;
+
+		probes.push_back(probe);
+		resetCycles();
+		return (int)probes.size() - 1;
+	}
+
+	void Project::removeProbe(int id) {
+		if (id < 0 || id >= (int)probes.size() || probes[id].gid < 0)
+			return;
+		probes[id].gid = -1;
+		updateProbeFlags();
+	}
+
+	void Project::updateProbeFlags() {
+		for (auto& flags : groupFlags)
+			flags &= ~FlagProbe;
+
+		probeIndex.clear();
+		for (size_t i = 0; i < probes.size(); i++)
+			if (probes[i].gid >= 0) {
+				const int src = sourceOf(probes[i].gid);
+				groupFlags[src] |= FlagProbe;
+				probeIndex.push_back({ src, (int)i });
+			}
+		std::sort(probeIndex.begin(), probeIndex.end());
+		probeIndexSorted = true;
+	}
+
+	bool Project::emitProbe(Probe& probe, unsigned long long tick) {
+		// A probe that found the ring full sends its value even if it went back,
+		// since the reader may not have the old one either
+		const bool on = getOn((Logic)observedState(probe.gid).logic);
+		if (on == probe.last && !probe.full)
+			return true;
+
+		ProbeRing* ring = probeRings[probe.ring];
+		if (!ring->push({ tick, probe.gid, (int)on })) {
+			// last stays what the reader has, so the change is sent once there is room.
+			// It is counted once however long it waits.
+			if (!probe.full)
+				ring->dropped.fetch_add(1, std::memory_order_relaxed);
+			probe.full = true;
+			return false;
+		}
+		probe.last = on;
+		probe.lastTick = tick;
+		probe.full = false;
+		return true;
+	}
+
+	void Project::captureProbes() {
+		if (!probeIndexSorted) {
+			std::sort(probeIndex.begin(), probeIndex.end());
+			probeIndexSorted = true;
+		}
+
+		for (int src : probeFlips) {
+			auto itr = std::lower_bound(probeIndex.begin(), probeIndex.end(), std::make_pair(src, -1));
+			for (; itr != probeIndex.end() && itr->first == src; itr++) {
+				Probe& probe = probes[itr->second];
+				if (probe.pending)
+					continue;
+				if (tickNum - probe.lastTick < (unsigned long long)probe.decimation ||
+					!emitProbe(probe, tickNum)) {
+					probe.pending = true;
+					probesPending.push_back(itr->second);
+				}
+			}
+		}
+		probeFlips.clear();
+
+		// Nothing flips in skipped idle ticks, so a late sample is stamped with the tick it was due.
+		// Samples that found the ring full are tried again every tick.
+		size_t n = 0;
+		for (int id : probesPending) {
+			Probe& probe = probes[id];
+			const unsigned long long due = probe.full ? tickNum : probe.lastTick + probe.decimation;
+			if (probe.gid < 0) {
+				probe.pending = false;
+				probe.full = false;
+			}
+			else if (tickNum >= due && emitProbe(probe, due))
+				probe.pending = false;
+			else
+				probesPending[n++] = id;
+		}
+		probesPending.resize(n);
+	}
+}
@@ -0,0 +1,93 @@
+// Code for reporting the activity counted with OVCB_PROFILE
+
+#include "openVCB.h"
+
+#ifdef OVCB_PROFILE
+#include <algorithm>
+
+namespace openVCB {
+	using namespace std;
+	using namespace glm;
+
+	void Project::resetProfile() {
+		std::fill(profile.begin(), profile.end(), GroupProfile{});
+	}
+
+	void Project::writeProfile(const std::string& path, int topN) {
+		FILE* file;
+		fopen_s(&file, path.c_str(), "w");
+		if (!file) {
+			printf("error: Could not open profile file %s\n", path.c_str());
+			return;
+		}
+
+		// Totals overall and by ink
+		GroupProfile total{};
+		std::map<Ink, GroupProfile> byInk;
+		for (int gid = 0; gid < numGroups; gid++) {
+			const GroupProfile& p = profile[gid];
+			GroupProfile& ink = byInk[stateInks[gid]];
+			ink.events += p.events;
+			ink.changes += p.changes;
+			ink.edges += p.edges;
+			total.events += p.events;
+			total.changes += p.changes;
+			total.edges += p.edges;
+		}
+
+		auto wasted = [](const GroupProfile& p) {
+			return p.events ? 100.0 * (p.events - p.changes) / p.events : 0.0;
+		};
+		fprintf(file, "events %llu changes %llu wasted %.1f%% edges %llu\n\n",
+			(unsigned long long)total.events, (unsigned long long)total.changes, wasted(total),
+			(unsigned long long)total.edges);
+		fprintf(file, "%-16s %14s %14s %8s %14s\n", "ink", "events", "changes", "wasted", "edges");
+		for (auto& ink : byInk)
+			if (ink.second.events)
+				fprintf(file, "%-16s %14llu %14llu %7.1f%% %14llu\n", getInkString(ink.first),
+					(unsigned long long)ink.second.events, (unsigned long long)ink.second.changes,
+					wasted(ink.second), (unsigned long long)ink.second.edges);
+
+		// Busiest groups
+		std::vector<int> top;
+		for (int gid = 0; gid < numGroups; gid++)
+			if (profile[gid].events)
+				top.push_back(gid);
+		topN = std::min(topN, (int)top.size());
+		std::partial_sort(top.begin(), top.begin() + topN, top.end(), [&](int a, int b) {
+			return profile[a].events > profile[b].events;
+		});
+		top.resize(topN);
+
+		// Find where they are drawn
+		std::unordered_map<int, int> rank;
+		for (int i = 0; i < topN; i++)
+			rank[top[i]] = i;
+		std::vector<int> pixels(topN, 0);
+		std::vector<ivec2> lo(topN, ivec2(width, height)), hi(topN, ivec2(-1));
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++) {
+				auto itr = rank.find(indexImage[x + y * width]);
+				if (itr == rank.end()) continue;
+				const int i = itr->second;
+				pixels[i]++;
+				lo[i] = glm::min(lo[i], ivec2(x, y));
+				hi[i] = glm::max(hi[i], ivec2(x, y));
+			}
+
+		fprintf(file, "\n%10s %-16s %14s %14s %8s %14s %7s %8s  %s\n",
+			"gid", "ink", "events", "changes", "wasted", "edges", "fanout", "pixels", "bounds");
+		for (int i = 0; i < topN; i++) {
+			const int gid = top[i];
+			const GroupProfile& p = profile[gid];
+			int fanout = 0;
+			forEachOutput(gid, [&](int, Logic, bool) { fanout++; });
+			fprintf(file, "%10d %-16s %14llu %14llu %7.1f%% %14llu %7d %8d  (%d, %d)-(%d, %d)\n",
+				gid, getInkString(stateInks[gid]), (unsigned long long)p.events, (unsigned long long)p.changes,
+				wasted(p), (unsigned long long)p.edges, fanout,
+				pixels[i], lo[i].x, lo[i].y, hi[i].x, hi[i].y);
+		}
+		fclose(file);
+	}
+}
+#endif
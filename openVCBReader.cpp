@@ -238,7 +238,10 @@ namespace openVCB {
 
 	bool Project::processLogicData(std::vector<unsigned char> logicData, int headerSize) {
 		unsigned long long imSize;
+		TraceScope zstd("zstd");
 		if (processData(logicData, headerSize, width, height, originalImage, imSize)) {
+			zstd.end();
+			OVCB_TRACE("color2ink");
 			image = new InkPixel[imSize];
 #pragma omp parallel for schedule(static, 8196)
 			for (int i = 0; i < imSize / 4; i++)
@@ -251,6 +254,7 @@ namespace openVCB {
 	}
 
 	void Project::Project::processDecorationData(std::vector<unsigned char> decorationData, int*& decoData) {
+		OVCB_TRACE("decoration");
 		unsigned long long imSize;
 		int width, height;
 		if (processData(decorationData, 24, width, height, (unsigned char*&)decoData, imSize)) {
@@ -262,11 +266,14 @@ namespace openVCB {
 	}
 
 	void Project::readFromVCB(std::string filePath) {
+		OVCB_TRACE("readFromVCB");
+		TraceScope readFile("read file");
 		std::ifstream stream(filePath);
 		std::stringstream ss;
 		ss << stream.rdbuf();
 		std::string godotObj = ss.str();
 		stream.close();
+		readFile.end();
 
 		if (godotObj.size() == 0) {
 			printf("Could not read file \"%s\"\n", filePath.c_str());
@@ -274,6 +281,7 @@ namespace openVCB {
 		}
 
 		// split out assembly
+		TraceScope parse("split");
 		int pos = 0;
 		split(godotObj, "\"assembly\": \"", pos);
 		assembly = split(godotObj, "\",", pos);
@@ -372,10 +380,17 @@ namespace openVCB {
 		vmData.size.x = vmemArr[12];
 		vmData.size.y = vmemArr[13];
 
+		parse.end();
+
 		if (vmemFlag) {
 			vmemSize = 1ull << vmAddr.numBits;
-			vmem = new int[vmemSize];
-			memset(vmem, 0, 4 * vmemSize);
+			// Wide address buses only get the pages they write to
+			if (vmAddr.numBits > denseVMemBits)
+				pagedVMem = new PagedVMem(vmAddr.numBits);
+			else {
+				vmem = new int[vmemSize];
+				memset(vmem, 0, 4 * vmemSize);
+			}
 		}
 
 		if (Project::processLogicData(logicData, 24)) {
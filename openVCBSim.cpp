@@ -1,63 +1,132 @@
 // Code for simulations
 
 #include "openVCB.h"
+#include <algorithm>
+#include <chrono>
+
+#ifdef OVCB_MT
+#include <omp.h>
+#endif
 
 namespace openVCB {
 	using namespace std;
 	using namespace glm;
 
+#ifdef OVCB_MT
+	// Emit queues per thread. One per type, one per type for deferQ,
+	// one for history flips and one for probe flips
+	const int numLocalQ = 2 * (int)Logic::numTypes + 2;
+#endif
+
+	// Steady time in nanoseconds for the phase timers
+	static inline long long phaseClock() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
 	SimulationResult Project::tick(int numTicks, long long maxEvents) {
+		OVCB_TRACE("tick", numTicks);
+
+		// Ticks from here on replace anything rewound
+		if (history)
+			truncateHistory();
+
 		SimulationResult res{};
-		for (; res.numTicksProcessed < numTicks; res.numTicksProcessed++) {
-			if (res.numEventsProcessed > maxEvents) return res;
 
-			for (auto itr = breakpoints.begin(); itr != breakpoints.end(); itr++) {
-				auto state = states[itr->first];
-				if (state.logic != (unsigned char)itr->second) {
-					itr->second = (Logic)state.logic;
-					res.breakpoint = true;
+		// Adds the time since the last lap to a phase. Reading the clock costs
+		// more than a tick on small boards, so this is off unless asked for.
+		const bool timed = timePhases;
+		long long lapStart = timed ? phaseClock() : 0;
+		auto lap = [&](long long& phaseTime) {
+			if (!timed) return;
+			const long long now = phaseClock();
+			phaseTime += now - lapStart;
+			lapStart = now;
+		};
+
+		for (; res.numTicksProcessed < numTicks; res.numTicksProcessed++) {
+			if (res.numEventsProcessed > maxEvents) break;
+
+			// Nothing can change before the clock fires again. Jump straight there.
+			unsigned long long idle = idleTicks();
+			if (idle > 0) {
+				idle = std::min(idle, (unsigned long long)(numTicks - res.numTicksProcessed));
+				for (auto& inst : instrumentBuffers) {
+					const InkState state = observedState(inst.idx);
+					for (unsigned long long k = idle - std::min(idle, (unsigned long long)inst.bufferSize); k < idle; k++)
+						inst.buffer[(tickNum + k) % inst.bufferSize] = state;
 				}
+
+				tickNum += idle;
+				// Boards without clocks idle forever, which can run past clockPeriod
+				clockCounter = (clockCounter + idle) % clockPeriod;
+				res.numTicksProcessed += (int)idle;
+				if (history)
+					recordIdle(idle);
+				if (probesPending.size())
+					captureProbes();
+				if (res.numTicksProcessed >= numTicks) break;
+			}
+
+			if (history) {
+				history->cur.ticks = 1;
+				history->cur.idle = false;
+				history->cur.clockCounter = clockCounter;
+				history->cur.lastVMemAddr = lastVMemAddr;
+			}
+
+			if (detectCycles && instrumentBuffers.empty() && probeIndex.empty() && !history) {
+				skipCycles(res, numTicks, maxEvents);
+				if (res.numTicksProcessed >= numTicks) break;
 			}
-			if (res.breakpoint) return res;
 
 			for (auto& inst : instrumentBuffers)
-				inst.buffer[tickNum % inst.bufferSize] = states[inst.idx];
+				inst.buffer[tickNum % inst.bufferSize] = observedState(inst.idx);
 
 			tickNum++;
+			lap(res.skipTime);
+
+			// VMem integration. Nothing to do unless a port latch flipped.
+			if (vmemDirty && hasVMem()) {
+				vmemDirty = false;
 
-			// VMem integration
-			if (vmem) {
 				// Get current address
 				uint32_t addr = 0;
 				for (int k = 0; k < vmAddr.numBits; k++)
-					addr |= (uint32_t)getOn((Logic)states[vmAddr.gids[k]].logic) << k;
+					addr |= (uint32_t)getOn((Logic)logicOf(vmAddr.gids[k])) << k;
 
 				if (addr != lastVMemAddr) {
 					// Load address
 					lastVMemAddr = addr;
-					int data = vmem[addr];
+					int data = readVMem(addr);
 
 					// Turn on those latches
 					for (int k = 0; k < vmData.numBits; k++) {
-						bool isOn = getOn((Logic)states[vmData.gids[k]].logic);
+						bool isOn = getOn((Logic)logicOf(vmData.gids[k]));
 						if (((data >> k) & 1) != isOn) {
-							states[vmData.gids[k]].activeInputs = 1;
-							if (states[vmData.gids[k]].visited) continue;
-							states[vmData.gids[k]].visited = 1;
-							updateQ[0][qSize++] = vmData.gids[k];
+							inputsOf(vmData.gids[k]) = 1;
+							pushEvent(vmData.gids[k]);
 						}
 					}
 
 					// Force ignore further address updates
 					for (int k = 0; k < vmAddr.numBits; k++)
-						states[vmAddr.gids[k]].activeInputs = 0;
+						inputsOf(vmAddr.gids[k]) = 0;
+
+					// Check again next tick in case the data latches did not take the value
+					vmemDirty = true;
 				}
 				else {
 					// Write address
 					int data = 0;
 					for (int k = 0; k < vmData.numBits; k++)
-						data |= (int)getOn((Logic)states[vmData.gids[k]].logic) << k;
-					vmem[addr] = data;
+						data |= (int)getOn((Logic)logicOf(vmData.gids[k])) << k;
+					const int old = readVMem(addr);
+					if (old != data) {
+						if (history)
+							history->cur.vmemWrites.push_back({ addr, (uint32_t)(old ^ data) });
+						writeVMem(addr, data);
+					}
 				}
 			}
 
@@ -66,117 +135,518 @@ namespace openVCB {
 				clockCounter = 0;
 			if (clockCounter < 2)
 				for (auto gid : clockGIDs)
-					if (!states[gid].visited)
-						updateQ[0][qSize++] = gid;
+					pushEvent(gid);
+			lap(res.vmemTime);
 
 			for (int traceUpdate = 0; traceUpdate < 2; traceUpdate++) { // We update twice per tick
 				// Remember stuff
-				const int numEvents = qSize;
-				res.numEventsProcessed += numEvents;
-				qSize = 0;
-
-				// Copy over the current number of active inputs
-				for (size_t i = 0; i < numEvents; i++) {
-					const int gid = updateQ[0][i];
-					const unsigned char ink = states[gid].logic;
-
-					// Reset visited flag
-					states[gid].visited = 0;
-
-					// Copy over last active inputs
-					lastActiveInputs[i] = states[gid].activeInputs;
-					if (ink == (unsigned char)Logic::Latch ||
-						ink == (unsigned char)Logic::LatchOff)
-						states[gid].activeInputs = 0;
+				int numEvents[(int)Logic::numTypes];
+				int totalEvents = 0;
+				for (int t = 0; t < (int)Logic::numTypes; t++) {
+					numEvents[t] = qSize[t];
+					totalEvents += numEvents[t];
+					qSize[t] = 0;
+				}
+				res.numEventsProcessed += totalEvents;
+				lifetimeEvents += totalEvents;
+				res.numHalfTicks++;
+				res.maxHalfTickEvents = std::max(res.maxHalfTickEvents, totalEvents);
+
+				// Start a new generation. This clears the visited flag of every pending event.
+				if (++epoch == 0) {
+					std::fill(visitEpoch, visitEpoch + numGroups, 0);
+					epoch = 1;
+				}
+
+				// Release the events held back by elided traces last half tick.
+				// They start the next queue.
+				if (deferQ)
+					for (int t = 0; t < (int)Logic::numTypes; t++) {
+						const int start = qStart[t];
+						const int end = start + deferSize[t];
+						for (int i = start; i < end; i++) {
+							const int gid = deferQ[i];
+							setVisited(gid);
+							updateQ[1][i] = gid;
+						}
+						qSize[t] = (int)deferSize[t];
+						deferSize[t] = 0;
+					}
+
+#ifdef OVCB_MT
+				const int threads = numThreads > 0 ? numThreads : omp_get_max_threads();
+				const bool multithreaded = threads > 1 && totalEvents >= mtMinEvents;
+#endif
+
+				if (history) {
+					history->curFlips = &history->cur.flips[traceUpdate];
+					history->curFlips->clear();
 				}
 
+				// Copy over the current number of active inputs.
+				// Only needed when an event can write to another event in the same queue.
+				if (!bipartite)
+					for (int t = 0; t < (int)Logic::numTypes; t++) {
+						const int start = qStart[t];
+						const int end = start + numEvents[t];
 #ifdef OVCB_MT
-#pragma omp parallel for schedule(static, 4 * 1024) num_threads(2) if(numEvents > 8 * 1024)
+#pragma omp parallel for schedule(static, 4 * 1024) num_threads(threads) if(multithreaded)
 #endif
-				// Main update loop
-				for (int i = 0; i < numEvents; i++) {
-					int gid = updateQ[0][i];
-					Logic curInk = (Logic)states[gid].logic;
-
-					const bool lastActive = getOn(curInk);
-					const int lastInputs = lastActiveInputs[i];
-					bool nextActive = false;
-
-					const Logic offInk = setOff(curInk);
-					switch (offInk) {
-					case Logic::NonZeroOff:
-						nextActive = lastInputs != 0;
-						break;
-
-					case Logic::ZeroOff:
-						nextActive = lastInputs == 0;
-						break;
-
-					case Logic::XorOff:
-						nextActive = lastInputs % 2;
-						break;
-
-					case Logic::XnorOff:
-						nextActive = !(lastInputs % 2);
-						break;
-
-					case Logic::LatchOff:
-						nextActive = lastActive ^ (lastInputs % 2);
-						break;
-
-					case Logic::ClockOff:
-						nextActive = clockCounter == 0;
-						break;
+						for (int i = start; i < end; i++) {
+							const int gid = updateQ[0][i];
+							lastActiveInputs[i] = inputsOf(gid);
+							if (t == (int)Logic::LatchOff)
+								inputsOf(gid) = 0;
+						}
 					}
+				lap(res.queueTime);
 
-					// Short circuit if the state didnt change
-					if (lastActive == nextActive)
-						continue;
+#ifdef OVCB_MT
+				if (multithreaded) {
+					if (threadQ.size() < (size_t)threads * numLocalQ)
+						threadQ.resize((size_t)threads * numLocalQ);
+
+#pragma omp parallel num_threads(threads)
+					{
+						std::vector<int>* localQ = &threadQ[omp_get_thread_num() * numLocalQ];
+						for (int t = 0; t < numLocalQ; t++)
+							localQ[t].clear();
+						EventTally localTally{};
+
+						processBucket<Logic::NonZeroOff, true>(numEvents[(int)Logic::NonZeroOff], localQ, localTally);
+						processBucket<Logic::ZeroOff, true>(numEvents[(int)Logic::ZeroOff], localQ, localTally);
+						processBucket<Logic::XorOff, true>(numEvents[(int)Logic::XorOff], localQ, localTally);
+						processBucket<Logic::XnorOff, true>(numEvents[(int)Logic::XnorOff], localQ, localTally);
+						processBucket<Logic::LatchOff, true>(numEvents[(int)Logic::LatchOff], localQ, localTally);
+						processBucket<Logic::ClockOff, true>(numEvents[(int)Logic::ClockOff], localQ, localTally);
+
+#pragma omp atomic
+						stateHash ^= localTally.hash;
+#pragma omp atomic
+						res.numStateChanges += localTally.changes;
+#pragma omp atomic
+						res.numEdgesTraversed += localTally.edges;
+#pragma omp atomic
+						res.numEmitsDeduped += localTally.deduped;
+
+						// Merge into the next queue
+						for (int t = 0; t < (int)Logic::numTypes; t++) {
+							const int base = qStart[t] + qSize[t].fetch_add((int)localQ[t].size(), std::memory_order_relaxed);
+							std::copy(localQ[t].begin(), localQ[t].end(), updateQ[1] + base);
+						}
+						if (deferQ)
+							for (int t = 0; t < (int)Logic::numTypes; t++) {
+								const std::vector<int>& q = localQ[(int)Logic::numTypes + t];
+								const int base = qStart[t] + deferSize[t].fetch_add((int)q.size(), std::memory_order_relaxed);
+								std::copy(q.begin(), q.end(), deferQ + base);
+							}
+					}
+
+					if (history)
+						for (int k = 0; k < threads; k++) {
+							const std::vector<int>& flips = threadQ[k * numLocalQ + 2 * (int)Logic::numTypes];
+							history->curFlips->insert(history->curFlips->end(), flips.begin(), flips.end());
+						}
+					if (probeIndex.size())
+						for (int k = 0; k < threads; k++) {
+							const std::vector<int>& flips = threadQ[k * numLocalQ + 2 * (int)Logic::numTypes + 1];
+							probeFlips.insert(probeFlips.end(), flips.begin(), flips.end());
+						}
+				}
+				else
+#endif
+				{
+					// Main update loops
+					EventTally tally{ stateHash, 0, 0, 0 };
+					processBucket<Logic::NonZeroOff, false>(numEvents[(int)Logic::NonZeroOff], nullptr, tally);
+					processBucket<Logic::ZeroOff, false>(numEvents[(int)Logic::ZeroOff], nullptr, tally);
+					processBucket<Logic::XorOff, false>(numEvents[(int)Logic::XorOff], nullptr, tally);
+					processBucket<Logic::XnorOff, false>(numEvents[(int)Logic::XnorOff], nullptr, tally);
+					processBucket<Logic::LatchOff, false>(numEvents[(int)Logic::LatchOff], nullptr, tally);
+					processBucket<Logic::ClockOff, false>(numEvents[(int)Logic::ClockOff], nullptr, tally);
+					stateHash = tally.hash;
+					res.numStateChanges += tally.changes;
+					res.numEdgesTraversed += tally.edges;
+					res.numEmitsDeduped += tally.deduped;
+				}
+
+				// Swap buffer
+				std::swap(updateQ[0], updateQ[1]);
+				lap(res.eventTime);
+			}
+
+			if (history)
+				pushRecord(history->cur);
+
+			// Only probes whose group flipped or that wait on decimation are looked at
+			if (probeFlips.size() || probesPending.size())
+				captureProbes();
+
+			// A watched group flipped. Stop once this tick is done.
+			if (watchHit || busHit) {
+				checkWatches(res);
+				if (res.breakpoint) {
+					// Skipping a period would now skip this breakpoint
+					resetCycles();
+					res.numTicksProcessed++;
+					lap(res.watchTime);
+					break;
+				}
+			}
+			lap(res.watchTime);
+		}
+
+		if (mirrors.size())
+			syncMirrors();
+		lap(res.skipTime);
+		return res;
+	}
 
-					// Update the state
-					states[gid].logic = (unsigned char)setOn(curInk, nextActive);
+	template<Logic type, bool multithreaded>
+	inline void Project::processBucket(int numEvents, std::vector<int>* localQ, EventTally& tally) {
+		const int start = qStart[(int)type];
+		const int end = start + numEvents;
 
-					// Loop over neighbors
-					const int delta = nextActive ? 1 : -1;
-					int r = writeMap.ptr[gid];
-					int end = writeMap.ptr[gid + 1];
-					for (; r < end; r++) {
-						const int nxtId = writeMap.rows[r];
-						const Logic nxtInk = setOff((Logic)states[nxtId].logic);
+#ifdef OVCB_MT
+		if constexpr (multithreaded) {
+			// Events are handed out in small chunks so threads that finish
+			// early pick up the remaining work from high fan-out groups.
+			// No barrier since events in one half tick do not depend on each other.
+#pragma omp for schedule(dynamic, 256) nowait
+			for (int i = start; i < end; i++)
+				processEvent<type, true>(i, localQ, tally);
+			return;
+		}
+#endif
 
-						// Ignore falling edge for latches
-						if (!nextActive && nxtInk == Logic::LatchOff)
-							continue;
+		for (int i = start; i < end; i++)
+			processEvent<type, false>(i, localQ, tally);
+	}
 
-						// Update actives
+	// Sets a flag that several threads may set at once
+	template<bool multithreaded>
+	static inline void raiseFlag(bool& flag) {
 #ifdef OVCB_MT
-						const int lastNxtInput = states[nxtId].activeInputs.fetch_add(delta, std::memory_order_relaxed);
-#else
-						const int lastNxtInput = states[nxtId].activeInputs;
-						states[nxtId].activeInputs = lastNxtInput + delta;
+		if constexpr (multithreaded) {
+			atomicRef(flag).store(true, std::memory_order_relaxed);
+			return;
+		}
 #endif
+		flag = true;
+	}
 
-						// Inks have convenient "critical points"
-						// We can skip any updates that do not hover around 0
-						// with a few exceptions.
-						if (lastNxtInput == 0 || lastNxtInput + delta == 0 ||
-							nxtInk == Logic::XorOff || nxtInk == Logic::XnorOff)
-							tryEmit(nxtId);
-					}
+	template<Logic type, bool multithreaded>
+	inline void Project::processEvent(int i, std::vector<int>* localQ, EventTally& tally) {
+		const int gid = updateQ[0][i];
+		const bool lastActive = getOn((Logic)logicOf(gid));
+#ifdef OVCB_PROFILE
+		// A group is updated by one thread per half tick, so plain adds are safe
+		profile[gid].events++;
+#endif
+
+		int lastInputs;
+		if (bipartite) {
+			// Nothing else in this queue writes to us
+			lastInputs = inputsOf(gid);
+			if constexpr (type == Logic::LatchOff)
+				inputsOf(gid) = 0;
+		}
+		else
+			lastInputs = lastActiveInputs[i];
+
+		bool nextActive;
+		if constexpr (type == Logic::NonZeroOff)
+			nextActive = lastInputs != 0;
+		else if constexpr (type == Logic::ZeroOff)
+			nextActive = lastInputs == 0;
+		else if constexpr (type == Logic::XorOff)
+			nextActive = lastInputs & 1;
+		else if constexpr (type == Logic::XnorOff)
+			nextActive = !(lastInputs & 1);
+		else if constexpr (type == Logic::LatchOff)
+			nextActive = lastActive ^ (lastInputs & 1);
+		else
+			nextActive = clockCounter == 0;
+
+		// Short circuit if the state didnt change
+		if (lastActive == nextActive)
+			return;
+
+		// Update the state
+		logicOf(gid) = (unsigned char)setOn(type, nextActive);
+		tally.hash ^= hashKey(gid);
+		tally.changes++;
+#ifdef OVCB_PROFILE
+		profile[gid].changes++;
+#endif
+		if (const unsigned char flags = groupFlags[gid]) {
+			if (flags & FlagVMemPort)
+				raiseFlag<multithreaded>(vmemDirty);
+			if (flags & FlagWatch)
+				raiseFlag<multithreaded>(watchHit);
+			if (flags & FlagBus)
+				raiseFlag<multithreaded>(busHit);
+			if (flags & FlagProbe) {
+#ifdef OVCB_MT
+				if constexpr (multithreaded)
+					localQ[2 * (int)Logic::numTypes + 1].push_back(gid);
+				else
+#endif
+				probeFlips.push_back(gid);
 			}
+		}
+		if (history) {
+#ifdef OVCB_MT
+			if constexpr (multithreaded)
+				localQ[2 * (int)Logic::numTypes].push_back(gid);
+			else
+#endif
+			history->curFlips->push_back(gid);
+		}
 
-				// Swap buffer
-				std::swap(updateQ[0], updateQ[1]);
+		if (nextActive)
+			fanOut<true, multithreaded>(gid, localQ, tally);
+		else
+			fanOut<false, multithreaded>(gid, localQ, tally);
+	}
+
+	template<bool rising, bool multithreaded>
+	inline void Project::fanOut(int gid, [[maybe_unused]] std::vector<int>* localQ, EventTally& tally) {
+		constexpr int delta = rising ? 1 : -1;
+		// Connections followed. Plain rows know their length. Packed rows are counted as they are decoded.
+		const bool packed = packedMap.data != nullptr;
+		long long edges = packed ? 0 : writeMap.ptr[gid + 1] - writeMap.ptr[gid];
+		long long deduped = 0;
+
+		// Loop over neighbors
+		forEachOutput(gid, [&](int nxtId, Logic nxtInk, bool delayed) {
+			if (packed)
+				edges++;
+
+			// Ignore falling edge for latches
+			if constexpr (!rising)
+				if (nxtInk == Logic::LatchOff)
+					return;
+
+			// Update actives
+			int lastNxtInput;
+#ifdef OVCB_MT
+			if constexpr (multithreaded)
+				lastNxtInput = atomicRef(inputsOf(nxtId)).fetch_add(delta, std::memory_order_relaxed);
+			else
+#endif
+			{
+				lastNxtInput = inputsOf(nxtId);
+				inputsOf(nxtId) = lastNxtInput + delta;
+			}
+
+			// Inks have convenient "critical points"
+			// We can skip any updates that do not hover around 0
+			// with a few exceptions.
+			if (lastNxtInput == 0 || lastNxtInput + delta == 0 ||
+				nxtInk == Logic::XorOff || nxtInk == Logic::XnorOff) {
+#ifdef OVCB_MT
+				if constexpr (multithreaded)
+					deduped += !tryEmit(nxtId, nxtInk, delayed ? localQ + (int)Logic::numTypes : localQ);
+				else
+#endif
+				if (delayed)
+					deduped += !tryDefer(nxtId, nxtInk);
+				else
+					deduped += !tryEmit(nxtId, nxtInk);
+			}
+		});
+		tally.edges += edges;
+		tally.deduped += deduped;
+#ifdef OVCB_PROFILE
+		profile[gid].edges += edges;
+#endif
+	}
+
+	void Project::writeVMem(uint32_t addr, int data) {
+		vmemHash ^= hashKey(((uint64_t)addr << 32) | (uint32_t)readVMem(addr)) ^
+			hashKey(((uint64_t)addr << 32) | (uint32_t)data);
+		if (!vmem) {
+			const uint32_t page = addr >> PagedVMem::pageBits;
+			if (snapshots.size() && !pagedVMemCopied.count(page))
+				copyVMemPage((int)page);
+			pagedVMem->write(addr, data);
+			return;
+		}
+		if (vmemPageShared.size() && vmemPageShared[addr / vmemPageSize])
+			copyVMemPage(addr / vmemPageSize);
+		vmem[addr] = data;
+	}
+
+	unsigned long long Project::idleTicks() const {
+		if (numPendingEvents()) return 0;
+
+		// VMem is idle if the address holds and the data is already stored
+		if (vmemDirty && hasVMem()) {
+			uint32_t addr = 0;
+			for (int k = 0; k < vmAddr.numBits; k++)
+				addr |= (uint32_t)getOn((Logic)logicOf(vmAddr.gids[k])) << k;
+			if (addr != lastVMemAddr) return 0;
+
+			int data = 0;
+			for (int k = 0; k < vmData.numBits; k++)
+				data |= (int)getOn((Logic)logicOf(vmData.gids[k])) << k;
+			if (readVMem(addr) != data) return 0;
+		}
+
+		if (clockGIDs.empty())
+			return ~0ull;
+
+		// The clock fires on the tick its counter wraps to 0 and on the one after
+		if (clockCounter == 0 || clockCounter + 1 >= clockPeriod)
+			return 0;
+		return clockPeriod - clockCounter - 1;
+	}
+
+	InkState Project::observedState(int gid) const {
+		const int src = sourceOf(gid);
+		if (src != gid) {
+			// Elided traces are on exactly when their only writer is
+			const bool on = getOn((Logic)logicOf(src));
+			return { (int16_t)on, 0, (unsigned char)setOn((Logic)logicOf(gid), on) };
+		}
+		return getState(gid);
+	}
+
+	int Project::sourceOf(int gid) const {
+		if (mirrors.size()) {
+			auto itr = std::lower_bound(mirrors.begin(), mirrors.end(), std::make_pair(gid, -1));
+			if (itr != mirrors.end() && itr->first == gid)
+				return itr->second;
+		}
+		return gid;
+	}
+
+	void Project::syncMirrors() {
+		for (auto& m : mirrors) {
+			const bool on = getOn((Logic)logicOf(m.second));
+			logicOf(m.first) = (unsigned char)setOn((Logic)logicOf(m.first), on);
+			inputsOf(m.first) = on;
 		}
 	}
-		return res;
-}
 
 	void Project::addBreakpoint(int gid) {
-		breakpoints[gid] = (Logic)states[gid].logic;
+		breakpoints[gid] = (Logic)observedState(gid).logic;
+		groupFlags[sourceOf(gid)] |= FlagWatch;
+		resetCycles();
 	}
 
 	void Project::removeBreakpoint(int gid) {
-		breakpoints.erase(gid);
+		if (breakpoints.erase(gid))
+			updateWatchFlags();
+	}
+
+	int Project::addBusWatch(const std::string& name, const std::vector<int>& gids,
+		BusCondition condition, uint64_t value, uint64_t mask) {
+		BusWatch watch{ name, gids, condition, value, mask, 0 };
+		if (watch.gids.size() > 64)
+			watch.gids.resize(64);
+		watch.last = readBus(watch.gids);
+		for (int gid : watch.gids)
+			groupFlags[sourceOf(gid)] |= FlagBus;
+
+		busWatches.push_back(watch);
+		resetCycles();
+		return (int)busWatches.size() - 1;
+	}
+
+	void Project::removeBusWatch(int id) {
+		if (id < 0 || id >= (int)busWatches.size() || busWatches[id].gids.empty())
+			return;
+		busWatches[id].gids.clear();
+		updateWatchFlags();
+	}
+
+	int Project::findBusWatch(const std::string& name) const {
+		for (size_t i = 0; i < busWatches.size(); i++)
+			if (busWatches[i].gids.size() && busWatches[i].name == name)
+				return (int)i;
+		return -1;
+	}
+
+	uint64_t Project::readBus(const std::vector<int>& gids) const {
+		uint64_t word = 0;
+		for (size_t k = 0; k < gids.size(); k++)
+			word |= (uint64_t)getOn((Logic)observedState(gids[k]).logic) << k;
+		return word;
+	}
+
+	void Project::updateWatchFlags() {
+		for (auto& flags : groupFlags)
+			flags &= ~(FlagWatch | FlagBus);
+		for (auto& bp : breakpoints)
+			groupFlags[sourceOf(bp.first)] |= FlagWatch;
+		for (auto& watch : busWatches)
+			for (int gid : watch.gids)
+				groupFlags[sourceOf(gid)] |= FlagBus;
+	}
+
+	void Project::rearmWatches() {
+		for (auto& bp : breakpoints)
+			bp.second = (Logic)observedState(bp.first).logic;
+		for (auto& watch : busWatches)
+			watch.last = readBus(watch.gids);
+
+		// Probes catch up with the jump in one sample each
+		probeFlips.clear();
+		probesPending.clear();
+		for (size_t i = 0; i < probes.size(); i++) {
+			Probe& probe = probes[i];
+			probe.pending = false;
+			if (probe.gid < 0) continue;
+			probe.lastTick = std::min(probe.lastTick, tickNum);
+			if (!emitProbe(probe, tickNum)) {
+				probe.pending = true;
+				probesPending.push_back((int)i);
+			}
+		}
+	}
+
+	void Project::checkWatches(SimulationResult& res) {
+		if (watchHit) {
+			watchHit = false;
+			for (auto& bp : breakpoints) {
+				const unsigned char state = observedState(bp.first).logic;
+				if (state != (unsigned char)bp.second) {
+					bp.second = (Logic)state;
+					res.breakpoint = true;
+				}
+			}
+		}
+
+		if (busHit) {
+			busHit = false;
+			for (size_t i = 0; i < busWatches.size(); i++) {
+				BusWatch& watch = busWatches[i];
+				const uint64_t word = readBus(watch.gids);
+				if (word == watch.last) continue;
+
+				bool fired;
+				switch (watch.condition) {
+				case BusCondition::Equal:
+					fired = word == watch.value;
+					break;
+				case BusCondition::NotEqual:
+					fired = word != watch.value;
+					break;
+				case BusCondition::Mask:
+					fired = (word & watch.mask) == watch.value;
+					break;
+				default:
+					fired = ((word ^ watch.last) & watch.mask) != 0;
+				}
+				watch.last = word;
+
+				if (fired && res.busWatch < 0) {
+					res.busWatch = (int)i;
+					res.breakpoint = true;
+				}
+			}
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,149 @@
+// Code for saving and restoring simulation states
+
+#include "openVCB.h"
+#include <algorithm>
+
+namespace openVCB {
+	using namespace std;
+	using namespace glm;
+
+	int Project::snapshot() {
+		if (mirrors.size())
+			syncMirrors();
+
+		Snapshot* snap = new Snapshot();
+		snap->tickNum = tickNum;
+		snap->clockCounter = clockCounter;
+		snap->lastVMemAddr = lastVMemAddr;
+		snap->stateHash = stateHash;
+		snap->vmemHash = vmemHash;
+		snap->lifetimeEvents = lifetimeEvents;
+
+		snap->logic.resize(numGroups);
+		snap->inputs.resize(numGroups);
+		for (int i = 0; i < numGroups; i++) {
+			snap->logic[i] = logicOf(i);
+			snap->inputs[i] = inputsOf(i);
+		}
+
+		for (int t = 0; t < (int)Logic::numTypes; t++) {
+			snap->qSize[t] = qSize[t];
+			snap->pending.insert(snap->pending.end(), updateQ[0] + qStart[t], updateQ[0] + qStart[t] + qSize[t]);
+		}
+
+		// Every page starts out shared with vmem
+		if (pagedVMem)
+			pagedVMemCopied.clear();
+		else if (vmem) {
+			const size_t numPages = (vmemSize + vmemPageSize - 1) / vmemPageSize;
+			snap->vmemPages.resize(numPages);
+			vmemPageShared.assign(numPages, 1);
+		}
+
+		snapshots.push_back(snap);
+		return (int)snapshots.size() - 1;
+	}
+
+	void Project::restore(int id) {
+		if (id < 0 || id >= (int)snapshots.size() || !snapshots[id])
+			return;
+		Snapshot* snap = snapshots[id];
+
+		for (int i = 0; i < numGroups; i++) {
+			logicOf(i) = snap->logic[i];
+			inputsOf(i) = snap->inputs[i];
+		}
+
+		// Start a new generation so only the restored events count as queued
+		if (++epoch == 0) {
+			std::fill(visitEpoch, visitEpoch + numGroups, 0);
+			epoch = 1;
+		}
+		const int* pending = snap->pending.data();
+		for (int t = 0; t < (int)Logic::numTypes; t++) {
+			qSize[t] = snap->qSize[t];
+			for (int i = 0; i < snap->qSize[t]; i++) {
+				const int gid = *pending++;
+				updateQ[0][qStart[t] + i] = gid;
+				setVisited(gid);
+			}
+		}
+
+		// Copy back the pages changed since. 
+		// Afterwards the snapshot shares them with vmem again.
+		if (pagedVMem) {
+			for (auto& saved : snap->pagedPages) {
+				const uint32_t addr = saved.first << PagedVMem::pageBits;
+				if (!pagedVMemCopied.count(saved.first))
+					copyVMemPage((int)saved.first);
+				if (saved.second)
+					std::copy(saved.second->begin(), saved.second->end(), pagedVMem->pageOf(addr));
+				else if (pagedVMem->findPage(addr)) {
+					// Pages are never freed, so one first written since goes back to zeros
+					int* page = pagedVMem->pageOf(addr);
+					std::fill(page, page + PagedVMem::pageSize, 0);
+				}
+				pagedVMemCopied.erase(saved.first);
+			}
+			snap->pagedPages.clear();
+		}
+		else if (vmem && snap->vmemPages.size() == vmemPageShared.size()) {
+			for (int page : snap->copiedPages) {
+				if (vmemPageShared[page])
+					copyVMemPage(page);
+				const std::vector<int>& data = *snap->vmemPages[page];
+				std::copy(data.begin(), data.end(), vmem + (size_t)page * vmemPageSize);
+				snap->vmemPages[page] = nullptr;
+				vmemPageShared[page] = 1;
+			}
+			snap->copiedPages.clear();
+		}
+
+		tickNum = snap->tickNum;
+		clockCounter = snap->clockCounter;
+		lastVMemAddr = snap->lastVMemAddr;
+		vmemDirty = true;
+		stateHash = snap->stateHash;
+		vmemHash = snap->vmemHash;
+		lifetimeEvents = snap->lifetimeEvents;
+
+		// Recorded ticks no longer lead up to this state
+		if (history)
+			recordHistory(history->data.size(), (int)history->starts.size() - 1);
+
+		// Breakpoints compare against the restored state
+		rearmWatches();
+		resetCycles();
+	}
+
+	void Project::deleteSnapshot(int id) {
+		if (id < 0 || id >= (int)snapshots.size() || !snapshots[id])
+			return;
+		delete snapshots[id];
+		snapshots[id] = nullptr;
+	}
+
+	void Project::copyVMemPage(int page) {
+		if (pagedVMem) {
+			// Snapshots already holding a copy keep it
+			const int* data = pagedVMem->findPage((uint32_t)page << PagedVMem::pageBits);
+			auto copy = data ? std::make_shared<std::vector<int>>(data, data + PagedVMem::pageSize) : nullptr;
+			for (auto snap : snapshots)
+				if (snap)
+					snap->pagedPages.emplace((uint32_t)page, copy);
+			pagedVMemCopied.insert((uint32_t)page);
+			return;
+		}
+
+		const size_t start = (size_t)page * vmemPageSize;
+		const size_t end = std::min(start + vmemPageSize, vmemSize);
+		auto copy = std::make_shared<std::vector<int>>(vmem + start, vmem + end);
+
+		for (auto snap : snapshots)
+			if (snap && (size_t)page < snap->vmemPages.size() && !snap->vmemPages[page]) {
+				snap->vmemPages[page] = copy;
+				snap->copiedPages.push_back(page);
+			}
+		vmemPageShared[page] = 0;
+	}
+}
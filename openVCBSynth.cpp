@@ -0,0 +1,319 @@
+// Code for generating circuits to benchmark with
+
+#include "openVCB.h"
+#include <algorithm>
+#include <queue>
+#include <climits>
+#include <cmath>
+
+namespace openVCB {
+	using namespace std;
+	using namespace glm;
+
+	const char* synthCircuitNames[] = {
+		"ripple",
+		"cla",
+		"shift",
+		"ram",
+		"divider",
+		"fanout",
+		"xortree"
+	};
+
+	// A gate and the nets it reads. The output of gate i is net i.
+	struct SynthGate {
+		Ink ink;
+		vector<int> inputs;
+	};
+
+	struct Netlist {
+		vector<SynthGate> gates;
+
+		int add(Ink ink, vector<int> inputs = {}) {
+			gates.push_back({ ink, std::move(inputs) });
+			return (int)gates.size() - 1;
+		}
+
+		// Grows a ripple counter on a clock to the given number of bits, fastest first.
+		// Gates are drawn in the order they are made, so adders grow it as they go
+		// to keep each bit next to its readers.
+		void counterTo(vector<int>& q, int bits) {
+			if (q.empty())
+				q.push_back(add(Ink::LatchOff, { add(Ink::ClockOff) }));
+			while ((int)q.size() < bits)
+				q.push_back(add(Ink::LatchOff, { q.back() }));
+		}
+
+		vector<int> counter(int bits) {
+			vector<int> q;
+			counterTo(q, bits);
+			return q;
+		}
+
+		// Latch that copies d on clock pulses.
+		// Latches toggle on rising inputs, so it toggles when d differs.
+		int flipFlop(int clk, int d) {
+			const int x = add(Ink::XorOff);
+			const int t = add(Ink::AndOff, { clk, x });
+			const int q = add(Ink::LatchOff, { t });
+			gates[x].inputs = { d, q };
+			return q;
+		}
+	};
+
+	static void rippleAdder(Netlist& net, int bits) {
+		vector<int> q;
+		int carry = -1;
+		for (int i = 0; i < bits; i++) {
+			net.counterTo(q, std::min(i + 2, bits));
+			const int a = q[i], b = q[(i + 1) % bits];
+			const int x = net.add(Ink::XorOff, { a, b });
+			const int g = net.add(Ink::AndOff, { a, b });
+			if (carry < 0) {
+				net.add(Ink::LedOff, { x });
+				carry = g;
+				continue;
+			}
+			const int s = net.add(Ink::XorOff, { x, carry });
+			const int p = net.add(Ink::AndOff, { x, carry });
+			carry = net.add(Ink::OrOff, { g, p });
+			net.add(Ink::LedOff, { s });
+		}
+		net.add(Ink::LedOff, { carry });
+	}
+
+	static void lookaheadAdder(Netlist& net, int bits) {
+		vector<int> q;
+		int carry = -1;
+		for (int base = 0; base < bits; base += 4) {
+			const int n = std::min(4, bits - base);
+			net.counterTo(q, std::min(base + n + 1, bits));
+			int p[4], g[4], c[5];
+			for (int k = 0; k < n; k++) {
+				const int a = q[base + k], b = q[(base + k + 1) % bits];
+				p[k] = net.add(Ink::XorOff, { a, b });
+				g[k] = net.add(Ink::AndOff, { a, b });
+			}
+
+			// Carry into bit k+1 is generated at some bit j and propagated by all above it
+			c[0] = carry;
+			for (int k = 0; k < n; k++) {
+				vector<int> terms = { g[k] };
+				for (int j = k - 1; j >= -1; j--) {
+					const int gen = j < 0 ? carry : g[j];
+					if (gen < 0) continue;
+					vector<int> in(p + j + 1, p + k + 1);
+					in.push_back(gen);
+					terms.push_back(net.add(Ink::AndOff, in));
+				}
+				c[k + 1] = terms.size() == 1 ? terms[0] : net.add(Ink::OrOff, terms);
+			}
+
+			for (int k = 0; k < n; k++)
+				net.add(Ink::LedOff, { c[k] < 0 ? p[k] : net.add(Ink::XorOff, { p[k], c[k] }) });
+			carry = c[n];
+		}
+		net.add(Ink::LedOff, { carry });
+	}
+
+	static void shiftRegister(Netlist& net, int bits) {
+		const int clk = net.add(Ink::ClockOff);
+		// The first stage reads the inverted last one. Patched in once it exists.
+		const int first = net.flipFlop(clk, -1);
+		int q = first;
+		for (int i = 1; i < bits; i++)
+			q = net.flipFlop(clk, q);
+		net.gates[first - 2].inputs[0] = net.add(Ink::NotOff, { q });
+	}
+
+	static void latchRAM(Netlist& net, int bits) {
+		int addrBits = 1;
+		while ((1 << addrBits) < bits) addrBits++;
+
+		// Data changes fastest so every write has something to store
+		vector<int> q = net.counter(bits + addrBits);
+		vector<int> addr, notAddr;
+		for (int i = 0; i < addrBits; i++) {
+			addr.push_back(q[bits + i]);
+			notAddr.push_back(net.add(Ink::NotOff, { addr[i] }));
+		}
+
+		const int clk = net.add(Ink::ClockOff);
+		vector<int> bitLines(bits, -1);
+		for (int w = 0; w < (1 << addrBits); w++) {
+			vector<int> sel;
+			for (int i = 0; i < addrBits; i++)
+				sel.push_back((w >> i) & 1 ? addr[i] : notAddr[i]);
+			const int read = net.add(Ink::AndOff, sel);
+			sel.push_back(clk);
+			const int write = net.add(Ink::AndOff, sel);
+
+			for (int b = 0; b < bits; b++) {
+				const int cell = net.flipFlop(write, q[b]);
+				const int out = net.add(Ink::AndOff, { read, cell });
+				bitLines[b] = bitLines[b] < 0 ? out : net.add(Ink::OrOff, { bitLines[b], out });
+			}
+		}
+		for (int b = 0; b < bits; b++)
+			net.add(Ink::LedOff, { bitLines[b] });
+	}
+
+	static void clockDivider(Netlist& net, int bits) {
+		vector<int> q = net.counter(bits);
+		net.add(Ink::LedOff, { q.back() });
+	}
+
+	static void fanoutBus(Netlist& net, int bits) {
+		// XOR reads are never skipped, so every flip of a line reaches all readers
+		vector<int> bus = net.counter(4);
+		for (int i = 0; i < bits; i++)
+			net.add(Ink::XorOff, bus);
+	}
+
+	// Parity of leaves [lo, hi). Made depth first so each net only spans its subtree.
+	static int xorSubtree(Netlist& net, const vector<int>& q, int lo, int hi) {
+		if (hi - lo == 1)
+			return q[lo % q.size()];
+		const int mid = (lo + hi) / 2;
+		const int a = xorSubtree(net, q, lo, mid);
+		const int b = xorSubtree(net, q, mid, hi);
+		return net.add(Ink::XorOff, { a, b });
+	}
+
+	static void xorTree(Netlist& net, int bits) {
+		vector<int> q = net.counter(std::min(bits, 8));
+		net.add(Ink::LedOff, { xorSubtree(net, q, 0, bits) });
+	}
+
+	// Draws a netlist as a row of components above a routing channel.
+	// Each pin gets its own column, two apart so neighbours never touch, with a
+	// read or write pixel under the component. Every net gets a horizontal track,
+	// shared by nets that do not overlap, and pins drop legs down to their track,
+	// crossing the tracks above it.
+	static vector<InkPixel> drawNetlist(const Netlist& net, int& tileWidth, int& tileHeight) {
+		const int numGates = (int)net.gates.size();
+
+		// Place pins. LEDs have no output.
+		vector<int> gateX(numGates);
+		vector<int> lo(numGates, INT_MAX), hi(numGates, -1);
+		int x = 0;
+		for (int g = 0; g < numGates; g++) {
+			const SynthGate& gate = net.gates[g];
+			gateX[g] = x;
+			for (int in : gate.inputs) {
+				lo[in] = std::min(lo[in], x);
+				hi[in] = std::max(hi[in], x);
+				x += 2;
+			}
+			if (gate.ink != Ink::LedOff) {
+				lo[g] = std::min(lo[g], x);
+				hi[g] = std::max(hi[g], x);
+				x += 2;
+			}
+		}
+		tileWidth = std::max(x, 1);
+
+		// Left edge channel routing. Tracks end on pin columns, which are never adjacent.
+		vector<int> order;
+		for (int g = 0; g < numGates; g++)
+			if (hi[g] > lo[g]) order.push_back(g);
+		std::sort(order.begin(), order.end(), [&](int a, int b) { return lo[a] < lo[b]; });
+		vector<int> track(numGates, -1);
+		priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> ends;
+		int numTracks = 0;
+		for (int g : order) {
+			if (ends.size() && ends.top().first < lo[g]) {
+				track[g] = ends.top().second;
+				ends.pop();
+			}
+			else
+				track[g] = numTracks++;
+			ends.push({ hi[g], track[g] });
+		}
+		// Track t sits on row 3 + 2t so legs have trace on both sides of each cross
+		tileHeight = 2 + 2 * numTracks;
+		auto trackRow = [](int t) { return 3 + 2 * t; };
+
+		vector<InkPixel> tile((size_t)tileWidth * tileHeight, InkPixel{ (int16_t)Ink::None, 0 });
+		auto at = [&](int x, int y) -> InkPixel& { return tile[x + (size_t)y * tileWidth]; };
+
+		for (int g = 0; g < numGates; g++)
+			if (track[g] >= 0)
+				for (int x = lo[g]; x <= hi[g]; x++)
+					at(x, trackRow(track[g])).ink = (int16_t)Ink::TraceOff;
+
+		auto drawPin = [&](int x, int n, Ink pin) {
+			at(x, 1).ink = (int16_t)pin;
+			if (track[n] < 0) return;
+			const int end = trackRow(track[n]);
+			for (int y = 2; y < end; y++) {
+				InkPixel& p = at(x, y);
+				p.ink = (int16_t)(p.ink == (int16_t)Ink::TraceOff ? Ink::Cross : Ink::TraceOff);
+			}
+		};
+
+		for (int g = 0; g < numGates; g++) {
+			const SynthGate& gate = net.gates[g];
+			int x = gateX[g];
+			const int numPins = (int)gate.inputs.size() + (gate.ink != Ink::LedOff);
+			for (int i = 0; i < 2 * numPins - 1; i++)
+				at(x + i, 0).ink = (int16_t)gate.ink;
+			for (int in : gate.inputs) {
+				drawPin(x, in, Ink::ReadOff);
+				x += 2;
+			}
+			if (gate.ink != Ink::LedOff)
+				drawPin(x, g, Ink::WriteOff);
+		}
+		return tile;
+	}
+
+	void Project::generateCircuit(SynthCircuit circuit, int bits, long long minPixels) {
+		OVCB_TRACE("generateCircuit");
+		bits = std::max(bits, 2);
+
+		Netlist net;
+		switch (circuit) {
+		case SynthCircuit::RippleAdder: rippleAdder(net, bits); break;
+		case SynthCircuit::LookaheadAdder: lookaheadAdder(net, bits); break;
+		case SynthCircuit::ShiftRegister: shiftRegister(net, bits); break;
+		case SynthCircuit::LatchRAM: latchRAM(net, bits); break;
+		case SynthCircuit::ClockDivider: clockDivider(net, bits); break;
+		case SynthCircuit::FanoutBus: fanoutBus(net, bits); break;
+		case SynthCircuit::XorTree: xorTree(net, bits); break;
+		default:
+			printf("error: Unknown circuit %d\n", (int)circuit);
+			exit(-1);
+		}
+
+		int tileWidth, tileHeight;
+		vector<InkPixel> tile = drawNetlist(net, tileWidth, tileHeight);
+		// Keep a blank row between copies
+		tileHeight++;
+		tile.resize((size_t)tileWidth * tileHeight, InkPixel{ (int16_t)Ink::None, 0 });
+
+		// Lay the copies out in a roughly square grid
+		const double tilePixels = (double)tileWidth * tileHeight;
+		const double copies = std::max(1.0, std::ceil(minPixels / tilePixels));
+		const long long cols = std::max(1ll, std::min((long long)std::ceil(copies),
+			(long long)std::round(std::sqrt(copies * tileHeight / tileWidth))));
+		const long long rows = (long long)std::ceil(copies / cols);
+		if ((double)cols * tileWidth * rows * tileHeight > INT_MAX) {
+			printf("error: Generated image of %lld x %lld pixels is too large\n",
+				cols * tileWidth, rows * tileHeight);
+			exit(-1);
+		}
+
+		width = (int)(cols * tileWidth);
+		height = (int)(rows * tileHeight);
+		if (image) delete[] image;
+		image = new InkPixel[(size_t)width * height];
+#pragma omp parallel for schedule(static, 16)
+		for (int y = 0; y < height; y++) {
+			const InkPixel* src = &tile[(size_t)(y % tileHeight) * tileWidth];
+			InkPixel* dst = image + (size_t)y * width;
+			for (long long c = 0; c < cols; c++)
+				std::copy(src, src + tileWidth, dst + c * tileWidth);
+		}
+	}
+}
@@ -0,0 +1,92 @@
+// Code for recording and writing traces
+
+#include "openVCBTrace.h"
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <stdio.h>
+
+namespace openVCB {
+	std::atomic<bool> tracing{ false };
+
+	struct TraceEvent {
+		const char* name;
+		long long start;
+		long long end;
+		long long arg;
+	};
+
+	// Spans of one thread. The lock is only contended while a trace is written.
+	struct TraceBuffer {
+		std::mutex lock;
+		std::vector<TraceEvent> events;
+		int tid;
+	};
+
+	// Every thread buffer ever made. Never freed, as threads keep pointers to them.
+	static std::mutex registryLock;
+	static std::vector<TraceBuffer*> buffers;
+	static long long traceStart = 0;
+
+	static TraceBuffer* threadBuffer() {
+		thread_local TraceBuffer* buffer = nullptr;
+		if (!buffer) {
+			std::lock_guard<std::mutex> guard(registryLock);
+			buffer = new TraceBuffer();
+			buffer->tid = (int)buffers.size();
+			buffers.push_back(buffer);
+		}
+		return buffer;
+	}
+
+	long long traceClock() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void traceSpan(const char* name, long long start, long long end, long long arg) {
+		TraceBuffer* buffer = threadBuffer();
+		std::lock_guard<std::mutex> guard(buffer->lock);
+		buffer->events.push_back({ name, start, end, arg });
+	}
+
+	void startTrace() {
+		std::lock_guard<std::mutex> guard(registryLock);
+		for (auto buffer : buffers) {
+			std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+			buffer->events.clear();
+		}
+		traceStart = traceClock();
+		tracing.store(true, std::memory_order_relaxed);
+	}
+
+	bool stopTrace(const std::string& path) {
+		tracing.store(false, std::memory_order_relaxed);
+
+		FILE* file;
+		fopen_s(&file, path.c_str(), "w");
+		if (!file) {
+			printf("error: Could not open trace file %s\n", path.c_str());
+			return false;
+		}
+
+		// Complete events with microsecond times. Names are literals and need no escaping.
+		fprintf(file, "{\"traceEvents\":[");
+		bool first = true;
+		std::lock_guard<std::mutex> guard(registryLock);
+		for (auto buffer : buffers) {
+			std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+			for (auto& e : buffer->events) {
+				fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+					first ? "" : ",", e.name, buffer->tid, (e.start - traceStart) / 1e3, (e.end - e.start) / 1e3);
+				if (e.arg >= 0)
+					fprintf(file, ",\"args\":{\"n\":%lld}", e.arg);
+				fprintf(file, "}");
+				first = false;
+			}
+		}
+		fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+		fclose(file);
+		return true;
+	}
+}
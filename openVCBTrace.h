@@ -0,0 +1,61 @@
+#pragma once
+/*
+* Timeline of the loading and simulation stages.
+* Spans are kept per thread and written as Chrome trace events,
+* which open in chrome://tracing and ui.perfetto.dev.
+*/
+
+#include <string>
+#include <atomic>
+
+namespace openVCB {
+	// Starts recording spans from every thread. Clears spans from an earlier trace.
+	void startTrace();
+
+	// Stops recording and writes the spans to a JSON file. Returns false if it could not be written.
+	bool stopTrace(const std::string& path);
+
+	// Set between startTrace() and stopTrace()
+	extern std::atomic<bool> tracing;
+
+	// Steady time in nanoseconds
+	long long traceClock();
+
+	// Stores a finished span in the buffer of the calling thread
+	void traceSpan(const char* name, long long start, long long end, long long arg);
+
+	// Records the lifetime of the object as a span. Costs a flag check when not tracing.
+	// name must outlive the trace, which string literals do.
+	struct TraceScope {
+		const char* name;
+		long long start;
+		long long arg;
+
+		inline TraceScope(const char* name, long long arg = -1) : name(name), arg(arg) {
+			start = tracing.load(std::memory_order_relaxed) ? traceClock() : -1;
+		}
+
+		inline ~TraceScope() {
+			end();
+		}
+
+		// Ends the span before the scope does
+		inline void end() {
+			if (start >= 0)
+				traceSpan(name, start, traceClock(), arg);
+			start = -1;
+		}
+
+		// Ends the span and starts the next one
+		inline void next(const char* nextName) {
+			end();
+			name = nextName;
+			start = tracing.load(std::memory_order_relaxed) ? traceClock() : -1;
+		}
+	};
+}
+
+#define OVCB_TRACE_CAT2(a, b) a##b
+#define OVCB_TRACE_CAT(a, b) OVCB_TRACE_CAT2(a, b)
+// Traces the rest of the enclosing scope
+#define OVCB_TRACE(...) openVCB::TraceScope OVCB_TRACE_CAT(traceScope, __LINE__)(__VA_ARGS__)
@@ -0,0 +1,195 @@
+// Code for writing VCD waveforms while the simulation runs
+
+#include "openVCB.h"
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+namespace openVCB {
+	using namespace std;
+	using namespace glm;
+
+	struct VCDExport {
+		FILE* file = nullptr;
+		ProbeRing* ring = nullptr;
+		std::thread thread;
+		std::atomic<bool> stop{ false };
+		// Probes feeding the ring, and the ring drop count when they were added
+		std::vector<int> probes;
+		unsigned long long dropped = 0;
+		// Ring drop count already marked in the file
+		unsigned long long marked = 0;
+
+		struct Signal {
+			std::string code;
+			// Bits as written to the file, most significant first
+			std::string value;
+			std::string written;
+			bool dirty;
+		};
+		std::vector<Signal> signals;
+		// Signal and bit of every probed group
+		std::unordered_map<int, std::vector<std::pair<int, int>>> bits;
+		// Signals changed at the current time
+		std::vector<int> dirty;
+		unsigned long long time = 0;
+		std::string out;
+
+		// Writes the changes made at the current time
+		void flushTime() {
+			if (dirty.empty()) return;
+			out += '#';
+			out += std::to_string(time);
+			out += '\n';
+			for (int i : dirty) {
+				Signal& sig = signals[i];
+				sig.dirty = false;
+				if (sig.value == sig.written) continue;
+				sig.written = sig.value;
+				if (sig.value.size() > 1) {
+					out += 'b';
+					out += sig.value;
+					out += ' ';
+				}
+				else
+					out += sig.value;
+				out += sig.code;
+				out += '\n';
+			}
+			dirty.clear();
+		}
+
+		void apply(const ProbeSample& s) {
+			// Ticks only go back after a rewind or restore. Those land on the current time.
+			if (s.tick > time) {
+				flushTime();
+				time = s.tick;
+			}
+			auto itr = bits.find(s.gid);
+			if (itr == bits.end()) return;
+			for (auto& b : itr->second) {
+				Signal& sig = signals[b.first];
+				sig.value[sig.value.size() - 1 - b.second] = s.value ? '1' : '0';
+				if (!sig.dirty) {
+					sig.dirty = true;
+					dirty.push_back(b.first);
+				}
+			}
+		}
+
+		// Notes lost changes after the last time written. The signals they belonged to
+		// pick up their values again with the next samples.
+		void markDropped() {
+			const unsigned long long lost = ring->dropped.load(std::memory_order_relaxed);
+			if (lost == marked) return;
+			out += "$comment " + std::to_string(lost - marked) + " changes lost to a full ring $end\n";
+			marked = lost;
+		}
+
+		void run() {
+			std::vector<ProbeSample> buf(4096);
+			for (;;) {
+				const bool last = stop.load(std::memory_order_acquire);
+				while (size_t n = ring->pop(buf.data(), buf.size())) {
+					for (size_t i = 0; i < n; i++)
+						apply(buf[i]);
+					if (out.size() > (1 << 20)) {
+						fwrite(out.data(), 1, out.size(), file);
+						out.clear();
+					}
+				}
+				markDropped();
+				if (last) break;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			flushTime();
+			fwrite(out.data(), 1, out.size(), file);
+			out.clear();
+		}
+	};
+
+	// Short printable identifier of the i-th signal
+	static std::string vcdCode(int i) {
+		std::string code;
+		do {
+			code += (char)(33 + i % 94);
+			i /= 94;
+		} while (i);
+		return code;
+	}
+
+	bool Project::startVCD(const std::string& path, const std::vector<VCDSignal>& signals, size_t ringSize) {
+		if (vcd) stopVCD();
+
+		// Reuse the ring of the last export if it is large enough
+		if (vcdRing < 0 || probeRings[vcdRing]->data.size() < ringSize) {
+			const int ring = createProbeRing(ringSize);
+			if (ring < 0) return false;
+			vcdRing = ring;
+		}
+
+		FILE* file;
+		fopen_s(&file, path.c_str(), "wb");
+		if (!file) {
+			printf("error: Could not open VCD file %s\n", path.c_str());
+			return false;
+		}
+
+		vcd = new VCDExport();
+		vcd->file = file;
+		vcd->time = tickNum;
+
+		std::string header = "$version openVCB $end\n$timescale 1 ns $end\n$scope module board $end\n";
+		for (size_t i = 0; i < signals.size(); i++) {
+			VCDExport::Signal sig{ vcdCode((int)i), std::string(signals[i].gids.size(), 'x'), "", false };
+			std::string name = signals[i].name;
+			std::replace(name.begin(), name.end(), ' ', '_');
+			header += "$var wire " + std::to_string(signals[i].gids.size()) + " " + sig.code + " " + name + " $end\n";
+			vcd->signals.push_back(sig);
+
+			for (size_t k = 0; k < signals[i].gids.size(); k++)
+				vcd->bits[signals[i].gids[k]].push_back({ (int)i, (int)k });
+		}
+		header += "$upscope $end\n$enddefinitions $end\n";
+		fwrite(header.data(), 1, header.size(), file);
+
+		vcd->ring = probeRings[vcdRing];
+		vcd->dropped = vcd->ring->dropped;
+		vcd->marked = vcd->dropped;
+
+		// The first samples give the starting values, so the writer has to be running
+		// to keep up with large numbers of groups
+		vcd->thread = std::thread(&VCDExport::run, vcd);
+		for (auto& b : vcd->bits)
+			vcd->probes.push_back(addProbe(b.first, vcdRing));
+		return true;
+	}
+
+	void Project::stopVCD() {
+		if (!vcd) return;
+
+		// Changes waiting on a full ring are handed over while the writer drains it,
+		// so the file ends on the current values
+		for (int id : vcd->probes)
+			while (probes[id].full && !emitProbe(probes[id], tickNum))
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		for (int id : vcd->probes)
+			removeProbe(id);
+		vcd->stop.store(true, std::memory_order_release);
+		vcd->thread.join();
+		fclose(vcd->file);
+
+		const unsigned long long dropped = vcdDropped();
+		if (dropped)
+			printf("error: VCD export lost %llu changes to a full ring\n", dropped);
+
+		delete vcd;
+		vcd = nullptr;
+	}
+
+	unsigned long long Project::vcdDropped() const {
+		if (!vcd) return 0;
+		return vcd->ring->dropped.load(std::memory_order_relaxed) - vcd->dropped;
+	}
+}
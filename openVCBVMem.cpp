@@ -0,0 +1,202 @@
+// Code for sparse and file backed vmem
+
+#include "openVCB.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace openVCB {
+	using namespace std;
+	using namespace glm;
+
+	struct VMemFile {
+		void* data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#endif
+	};
+
+	int PagedVMem::zeroPage[PagedVMem::pageSize] = {};
+	int* PagedVMem::zeroTable[1 << PagedVMem::tableBits];
+
+	PagedVMem::PagedVMem(int addrBits) {
+		// Filled on first use so PagedVMems made during static initialization still see it
+		[[maybe_unused]] static const bool zeroTableReady = [] {
+			std::fill(zeroTable, zeroTable + (1 << tableBits), (int*)zeroPage);
+			return true;
+		}();
+
+		numTables = (size_t)1 << std::max(0, addrBits - pageBits - tableBits);
+		tables = new int** [numTables];
+		std::fill(tables, tables + numTables, (int**)zeroTable);
+	}
+
+	PagedVMem::~PagedVMem() {
+		for (size_t t = 0; t < numTables; t++) {
+			if (tables[t] == zeroTable) continue;
+			for (uint32_t p = 0; p <= tableMask; p++)
+				if (tables[t][p] != zeroPage)
+					delete[] tables[t][p];
+			delete[] tables[t];
+		}
+		delete[] tables;
+	}
+
+	int* PagedVMem::pageOf(uint32_t addr) {
+		int**& table = tables[addr >> (pageBits + tableBits)];
+		if (table == zeroTable) {
+			table = new int* [1 << tableBits];
+			std::fill(table, table + (1 << tableBits), (int*)zeroPage);
+		}
+
+		int*& page = table[(addr >> pageBits) & tableMask];
+		if (page == zeroPage) {
+			page = new int[pageSize]();
+			numPages++;
+		}
+		return page;
+	}
+
+	void PagedVMem::save(std::vector<uint32_t>& addrs, std::vector<int>& data) const {
+		addrs.clear();
+		data.clear();
+		forEachPage([&](uint32_t addr, const int* page) {
+			addrs.push_back(addr);
+			data.insert(data.end(), page, page + pageSize);
+		});
+	}
+
+	bool PagedVMem::equals(const std::vector<uint32_t>& addrs, const std::vector<int>& data) const {
+		// Pages are never freed so every saved page is still allocated.
+		// Pages allocated since must still be zero.
+		size_t k = 0;
+		bool res = true;
+		forEachPage([&](uint32_t addr, const int* page) {
+			if (!res) return;
+			const int* saved = zeroPage;
+			if (k < addrs.size() && addrs[k] == addr)
+				saved = data.data() + pageSize * k++;
+			res = std::equal(page, page + pageSize, saved);
+		});
+		return res && k == addrs.size();
+	}
+
+	// Maps size bytes of a file, growing it if needed. fresh is set if it had to grow.
+	static VMemFile* openVMemFile(const std::string& path, size_t size, bool& fresh) {
+		VMemFile* res = new VMemFile();
+		res->size = size;
+
+#ifdef _WIN32
+		res->file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+			nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER fileSize;
+		if (res->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(res->file, &fileSize)) {
+			if (res->file != INVALID_HANDLE_VALUE) CloseHandle(res->file);
+			delete res;
+			return nullptr;
+		}
+		fresh = (unsigned long long)fileSize.QuadPart < size;
+
+		// Mapping past the end grows the file
+		res->mapping = CreateFileMappingA(res->file, nullptr, PAGE_READWRITE,
+			(DWORD)((unsigned long long)size >> 32), (DWORD)size, nullptr);
+		if (res->mapping)
+			res->data = MapViewOfFile(res->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+		if (!res->data) {
+			if (res->mapping) CloseHandle(res->mapping);
+			CloseHandle(res->file);
+			delete res;
+			return nullptr;
+		}
+#else
+		const int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		struct stat st;
+		if (fd < 0 || fstat(fd, &st) != 0) {
+			if (fd >= 0) close(fd);
+			delete res;
+			return nullptr;
+		}
+		fresh = (size_t)st.st_size < size;
+		if (fresh && ftruncate(fd, (off_t)size) != 0) {
+			close(fd);
+			delete res;
+			return nullptr;
+		}
+
+		// The mapping keeps the file open
+		void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED) {
+			delete res;
+			return nullptr;
+		}
+		res->data = data;
+#endif
+		return res;
+	}
+
+	bool Project::mapVMem(const std::string& path) {
+		if (!vmem) {
+			printf("error: %s\n", pagedVMem ? "Only a flat vmem can be mapped to a file" : "Project has no vmem");
+			return false;
+		}
+
+		bool fresh = false;
+		VMemFile* file = openVMemFile(path, vmemSize * sizeof(int), fresh);
+		if (!file) {
+			printf("error: Could not map vmem file %s\n", path.c_str());
+			return false;
+		}
+		int* data = (int*)file->data;
+
+		if (fresh)
+			std::copy(vmem, vmem + vmemSize, data);
+		else {
+			// Snapshots sharing pages with vmem keep the old contents
+			for (size_t page = 0; page < vmemPageShared.size(); page++)
+				if (vmemPageShared[page])
+					copyVMemPage((int)page);
+
+			// Hash the mapped words as if writeVMem() had stored them into a zeroed vmem
+			vmemHash = 0;
+			for (size_t addr = 0; addr < vmemSize; addr++)
+				if (data[addr])
+					vmemHash ^= hashKey(((uint64_t)addr << 32) | (uint32_t)data[addr]) ^ hashKey((uint64_t)addr << 32);
+
+			// Recorded ticks no longer lead up to this vmem
+			if (history)
+				recordHistory(history->data.size(), (int)history->starts.size() - 1);
+			vmemDirty = true;
+			resetCycles();
+		}
+
+		if (vmemFile) closeVMemFile();
+		else delete[] vmem;
+		vmem = data;
+		vmemFile = file;
+		vmemFromFile = !fresh;
+		return true;
+	}
+
+	void Project::closeVMemFile() {
+#ifdef _WIN32
+		UnmapViewOfFile(vmemFile->data);
+		CloseHandle(vmemFile->mapping);
+		CloseHandle(vmemFile->file);
+#else
+		munmap(vmemFile->data, vmemFile->size);
+#endif
+		delete vmemFile;
+		vmemFile = nullptr;
+	}
+}